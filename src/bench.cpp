@@ -0,0 +1,333 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "edges.h"
+#include "capture.h"
+#include "recorder.h"
+#include "replay.h"
+#include "trace.h"
+
+#ifndef DISABLE_DARKNET
+#include "darknet.h"
+#include "rendering.h"
+#include "text.h"
+#endif
+
+/*conhud-bench pushes frames through the same capture, detection, edge, overlay and encoding code as
+  conhud, without a window, as fast as the pipeline allows, and reports the throughput as JSON*/
+
+Globals global;
+
+/*how long each frame spent in one stage*/
+struct stage_samples {
+  std::string name;
+  std::vector<double> ms;
+};
+
+static void printUsage() {
+  std::printf("Usage: conhud-bench [-c FOURCC] [-d] [-D FILE] [-e DETECTOR] [-E] [-F FPS] [-j FILE] [-n FRAMES] [-o FILE] [-O] [-s SOURCE] [-W FRAMES]\n");
+}
+
+/*parses a number of frames, which must be a non-negative integer*/
+static bool parseFrameCount(const char* spec, long& frames) {
+  char* end;
+  long const value = std::strtol(spec, &end, 10);
+  if (end == spec || *end != '\0' || value < 0) { return false; }
+  frames = value;
+  return true;
+}
+
+static double percentile(std::vector<double> values, double p) {
+  if (values.empty()) { return 0.0; }
+  size_t const n = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+  std::nth_element(values.begin(), values.begin() + n, values.end());
+  return values[n];
+}
+
+static void writeReport(std::ostream& out, std::string const& source, unsigned long frames, double seconds,
+                        bool timed_out, unsigned long dropped, std::vector<stage_samples> const& stages, session_replay const* replayed) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  out << std::fixed << std::setprecision(3);
+  out << "{\n";
+  out << "  \"source\": ";
+  writeJsonString(out, source);
+  out << ",\n";
+  out << "  \"frames\": " << frames << ",\n";
+  out << "  \"seconds\": " << seconds << ",\n";
+  out << "  \"fps\": " << (seconds > 0 ? frames / seconds : 0.0) << ",\n";
+  out << "  \"timed_out\": " << (timed_out ? "true" : "false") << ",\n"; //the source stalled before the run was complete
+  out << "  \"dropped\": " << dropped << ",\n";
+  out << "  \"peak_rss_kb\": " << usage.ru_maxrss << ",\n"; //kilobytes on Linux
+  if (replayed) {
+    auto const diff = replayed->stats();
+    out << "  \"detection_diff\": {\"frames\": " << diff.frames << ", \"differing\": " << diff.differing
+        << ", \"matched\": " << diff.matched << ", \"missing\": " << diff.missing << ", \"extra\": " << diff.extra << "},\n";
+  }
+  out << "  \"stages\": {";
+  bool first = true;
+  for (auto const& stage : stages) {
+    if (stage.ms.empty()) { continue; }
+    double const mean = std::accumulate(stage.ms.begin(), stage.ms.end(), 0.0) / stage.ms.size();
+    out << (first ? "\n" : ",\n") << "    \"" << stage.name << "\": {"
+        << "\"count\": " << stage.ms.size()
+        << ", \"mean_ms\": " << mean
+        << ", \"p50_ms\": " << percentile(stage.ms, 0.50)
+        << ", \"p95_ms\": " << percentile(stage.ms, 0.95)
+        << ", \"p99_ms\": " << percentile(stage.ms, 0.99)
+        << ", \"max_ms\": " << *std::max_element(stage.ms.begin(), stage.ms.end()) << "}";
+    first = false;
+  }
+  out << "\n  }\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+
+  std::string source = "0";
+  std::string json_file;
+  std::string out_videofile;
+  recorder_options recording; //the codec and rate conhud records with, the path is out_videofile
+  bool record_fps_given = false; //otherwise the output follows the source's rate
+  long max_frames = 0; //0 runs until the source ends
+  long warmup_frames = 10; //left out of the statistics
+  bool run_edges = false, edges_only = false, run_overlay = false;
+  edge_detector edge_mode = edge_detector::canny;
+
+#ifndef DISABLE_DARKNET
+  bool run_detection = false;
+  std::string diff_file;
+  std::string names_file = "darknet/data/custom.names";
+  std::string cfg_file = "darknet/cfg/yolo-voc.2.0.cfg";
+  std::string weights_file = "darknet/yolo-voc_custom.weights";
+#endif
+
+  int c;
+  while ((c = getopt(argc, argv, "c:dD:e:EF:hj:n:o:Os:W:")) != -1) {
+    switch (c) {
+      case 'c': //codec of the encoded output
+        recording.fourcc = optarg;
+        if (recording.fourcc.size() != 4) {
+          std::printf("A codec is given as a FourCC, not '%s'\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+#ifndef DISABLE_DARKNET
+      case 'd': //run the detector on every frame
+        run_detection = true;
+        break;
+      case 'D': //compare the detections with a replayed session log
+        diff_file = optarg;
+        run_detection = true;
+        break;
+#endif
+      case 'e': //edge filter
+        if (!parseEdgeDetector(optarg, edge_mode)) {
+          std::printf("Unknown edge detector '%s'\n", optarg);
+          return EXIT_FAILURE;
+        }
+        run_edges = true;
+        break;
+      case 'E': //edges only
+        run_edges = true;
+        edges_only = true;
+        break;
+      case 'F': //frame rate of the encoded output
+        if (!parseRecordFps(optarg, recording.fps)) {
+          std::printf("Invalid recording frame rate '%s', give a positive number of frames per second\n", optarg);
+          return EXIT_FAILURE;
+        }
+        record_fps_given = true;
+        break;
+      case 'h': //help
+        printUsage();
+        return EXIT_SUCCESS;
+      case 'j': //report file
+        json_file = optarg;
+        break;
+      case 'n': //frames to process
+        if (!parseFrameCount(optarg, max_frames)) {
+          std::printf("Invalid frame count '%s'\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'o': //encode to a video file
+        out_videofile = optarg;
+        break;
+      case 'O': //draw the overlay into the frames
+        run_overlay = true;
+        break;
+      case 's': //source
+        source = optarg;
+        break;
+      case 'W': //warmup frames
+        if (!parseFrameCount(optarg, warmup_frames)) {
+          std::printf("Invalid warmup frame count '%s'\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case '?':
+        if (optopt == 'c' || optopt == 'D' || optopt == 'e' || optopt == 'F' || optopt == 'j' || optopt == 'n' || optopt == 'o' || optopt == 's' || optopt == 'W') {
+          std::printf("Option -%c requires an argument.\n", optopt);
+        } else if (isprint(optopt)) {
+          std::printf("Unknown option '-%c'\n", optopt);
+        }
+        return EXIT_FAILURE;
+      default:
+        break;
+    }
+  }
+
+#ifndef DISABLE_DARKNET
+  std::unique_ptr<Detector> detector;
+  std::unique_ptr<detector_input> input;
+  std::vector<std::string> object_names;
+  if (run_detection) {
+    detector.reset(new Detector(cfg_file, weights_file));
+    input.reset(new detector_input(detector->get_net_width(), detector->get_net_height()));
+    object_names = objectNamesFromFile(names_file);
+  }
+  std::vector<bbox_t> boxes;
+  std::vector<overlay_instance> overlay;
+  std::vector<text_item> labels;
+#endif
+  edge_overlay edges(edge_mode);
+
+  std::unique_ptr<session_replay> replayed;
+#ifndef DISABLE_DARKNET
+  std::vector<session_box> compared_boxes;
+  std::ofstream diff_report;
+  if (!diff_file.empty()) {
+    std::string replay_path;
+    double replay_speed;
+    replayed.reset(new session_replay());
+    if (!parseReplaySpec(source, replay_path, replay_speed) || !replayed->open(replay_path)) {
+      std::printf("-D needs a session log as the source (replay:FILE)\n");
+      return EXIT_FAILURE;
+    }
+    diff_report.open(diff_file);
+    if (!diff_report) { std::printf("Failed to open %s for writing\n", diff_file.c_str()); return EXIT_FAILURE; }
+  }
+#endif
+
+/*the bench must see every frame of the source, so the capture thread waits instead of dropping,
+  and video files are decoded as fast as they are taken unless a speed is given*/
+  auto frames = openFrameSource(source, 0);
+  if (!frames) { std::printf("Failed to open %s!\n", source.c_str()); return EXIT_FAILURE; }
+  capture_stream stream(std::move(frames), queue_policy::fifo, std::chrono::milliseconds(0));
+  if (!stream.start()) { std::printf("Failed to capture a frame from %s!\n", source.c_str()); return EXIT_FAILURE; }
+
+/*encoded with the same codec and rate as conhud records, but on this thread, so the encode stage
+  times the encoder itself*/
+  cv::VideoWriter output_video;
+  if (!out_videofile.empty()) {
+    double const source_fps = stream.input().frameRate();
+    if (!record_fps_given && source_fps > 0) { recording.fps = source_fps; }
+    std::string const& fourcc = recording.fourcc;
+    output_video.open(out_videofile, CV_FOURCC(fourcc[0], fourcc[1], fourcc[2], fourcc[3]), recording.fps, stream.frameSize(), true);
+    if (!output_video.isOpened()) { std::printf("Failed to open %s for writing\n", out_videofile.c_str()); return EXIT_FAILURE; }
+  }
+
+  enum {QUEUE_WAIT, PREPROCESS, DETECT, EDGES, OVERLAY, ENCODE, LATENCY, STAGE_COUNT};
+  std::vector<stage_samples> stages(STAGE_COUNT);
+  stages[QUEUE_WAIT].name = "queue_wait";
+  stages[PREPROCESS].name = "preprocess";
+  stages[DETECT].name = "detect";
+  stages[EDGES].name = "edges";
+  stages[OVERLAY].name = "overlay";
+  stages[ENCODE].name = "encode";
+  stages[LATENCY].name = "latency"; //capture to the end of the last stage
+
+  typedef std::chrono::steady_clock clock;
+  auto elapsed = [](clock::time_point from, clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+  };
+
+  long frame_count = 0;
+  unsigned long measured = 0;
+  bool timed_out = false;
+  clock::time_point started;
+
+  while (max_frames <= 0 || frame_count < max_frames + warmup_frames) {
+    if (frame_count == warmup_frames) { started = clock::now(); }
+    bool const record = frame_count >= warmup_frames;
+
+    image_data image;
+    auto t0 = clock::now();
+    if (!stream.queue().pop(image, t0 + std::chrono::seconds(5))) {
+      std::printf("Timed out waiting for a frame\n");
+      timed_out = true;
+      break;
+    }
+    if (image.frame.empty()) { break; } //end of the source
+    auto t1 = clock::now();
+    if (record) { stages[QUEUE_WAIT].ms.push_back(elapsed(t0, t1)); }
+
+#ifndef DISABLE_DARKNET
+    if (run_detection) {
+      t0 = clock::now();
+      image_t const& tensor = input->convert(image.frame);
+      t1 = clock::now();
+      boxes = detector->detect_resized(tensor, image.frame.size());
+      auto const t2 = clock::now();
+      if (record) {
+        stages[PREPROCESS].ms.push_back(elapsed(t0, t1));
+        stages[DETECT].ms.push_back(elapsed(t1, t2));
+      }
+/*every frame is detected here, so any difference to the recorded boxes is a change in behavior*/
+      if (replayed) {
+        toSessionBoxes(boxes, compared_boxes);
+        replayed->compare(image.frame_id, compared_boxes, &diff_report);
+      }
+    }
+#endif
+
+    if (run_edges) {
+      t0 = clock::now();
+      edges.apply(image.frame, edges_only);
+      if (record) { stages[EDGES].ms.push_back(elapsed(t0, clock::now())); }
+    }
+
+    if (run_overlay) {
+      t0 = clock::now();
+#ifndef DISABLE_DARKNET
+/*the display would upload these to the GPU, the recording burns the same boxes into the pixels*/
+      buildOverlay(boxes, object_names, image.frame.size(), overlay, labels);
+      drawBoxes(image.frame, boxes, object_names);
+#endif
+      if (record) { stages[OVERLAY].ms.push_back(elapsed(t0, clock::now())); }
+    }
+
+    if (output_video.isOpened()) {
+      t0 = clock::now();
+      output_video << image.frame;
+      if (record) { stages[ENCODE].ms.push_back(elapsed(t0, clock::now())); }
+    }
+
+    if (record) {
+      stages[LATENCY].ms.push_back(elapsed(image.timestamp, clock::now()));
+      measured++;
+    }
+    stream.pool().release(image.slot);
+    frame_count++;
+  }
+
+  double const seconds = measured ? elapsed(started, clock::now()) / 1000.0 : 0.0;
+  unsigned long const dropped = stream.queue().dropped();
+  stream.stop();
+
+  if (json_file.empty()) {
+    writeReport(std::cout, source, measured, seconds, timed_out, dropped, stages, replayed.get());
+  } else {
+    std::ofstream out(json_file);
+    writeReport(out, source, measured, seconds, timed_out, dropped, stages, replayed.get());
+    if (!out) { std::printf("Failed to write %s\n", json_file.c_str()); return EXIT_FAILURE; }
+  }
+
+/*the report is still written, but a stalled source must not pass for one that simply ended*/
+  return timed_out ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "capture.h"
+#include "synth.h"
+#include "replay.h"
+#include "v4l2.h"
+#include "playback.h"
+#include "trace.h"
+
+opencv_source::opencv_source(std::string const& source) {
+  if (isdigit(source[0])) {
+    capture.open(stoi(source));
+  }
+}
+
+double opencv_source::frameRate() const {
+  double const fps = capture.get(cv::CAP_PROP_FPS);
+  return fps > 0 ? fps : 0; //many cameras do not say
+}
+
+bool parseStreamIndex(std::string const& spec, int& index) {
+  char* end;
+  long const value = std::strtol(spec.c_str(), &end, 10);
+  if (end == spec.c_str() || *end != '\0' || value < 0 || value > INT_MAX) { return false; }
+  index = static_cast<int>(value);
+  return true;
+}
+
+std::unique_ptr<frame_source> openFrameSource(std::string const& source, double file_speed) {
+  if (source == "synth" || source.compare(0, 6, "synth:") == 0) {
+    synth_options options;
+    if (!parseSynthSpec(source, options)) { return nullptr; }
+    return std::unique_ptr<frame_source>(new synth_source(options));
+  }
+  if (source.compare(0, 7, "replay:") == 0) {
+    std::string path;
+    double speed;
+    if (!parseReplaySpec(source, path, speed)) { return nullptr; }
+    std::unique_ptr<replay_source> replay(new replay_source(path, speed));
+    if (!replay->isOpened()) { return nullptr; }
+    return std::move(replay);
+  }
+  if (source == "v4l2" || source.compare(0, 5, "v4l2:") == 0) {
+    v4l2_options options;
+    if (!parseV4l2Spec(source, options)) { return nullptr; }
+    std::unique_ptr<v4l2_source> camera(new v4l2_source(options));
+    if (!camera->isOpened()) { return nullptr; }
+    return std::move(camera);
+  }
+  std::string path;
+  playback_options playback;
+  playback.speed = file_speed;
+  if (parsePlaybackSpec(source, path, playback)) {
+    std::unique_ptr<file_source> file(new file_source(path, playback));
+    if (!file->isOpened()) { return nullptr; }
+    return std::move(file);
+  }
+  std::unique_ptr<opencv_source> capture(new opencv_source(source));
+  if (!capture->isOpened()) { return nullptr; }
+  return std::move(capture);
+}
+
+capture_stream::capture_stream(std::unique_ptr<frame_source> source, queue_policy policy, std::chrono::milliseconds max_age)
+  : source(std::move(source)), policy(policy), max_age(max_age) {}
+
+capture_stream::~capture_stream() {
+  stop();
+}
+
+bool capture_stream::start() {
+  int const queue_capacity = (policy == queue_policy::latest) ? 1 : 10;
+  image_data first;
+
+  buffers = source->ownBuffers();
+/*zero-copy: the frames stay in the source's buffers all the way to the display; besides a full
+  queue, one is being processed, one is on display and the source needs one to capture into.
+  A driver that grants fewer buffers than that is read through copies instead*/
+  if (buffers && buffers->count() < queue_capacity + 3) {
+    std::printf("The source has %d buffers, a queue of %d frames needs at least %d to share them, copying frames instead\n",
+                buffers->count(), queue_capacity, queue_capacity + 3);
+    buffers = NULL;
+  }
+  if (buffers) {
+    first.slot = source->dequeue();
+    if (first.slot < 0) { return false; }
+    first.frame = buffers->frame(first.slot);
+    frame_size = first.frame.size();
+  } else {
+    cv::Mat first_frame;
+    source->read(first_frame);
+    if (first_frame.empty()) { return false; }
+    frame_size = first_frame.size();
+
+/*one buffer per queue entry, plus one being captured and one being processed*/
+    own_buffers.reset(new frame_pool(queue_capacity + 2, frame_size));
+    buffers = own_buffers.get();
+    first.slot = buffers->acquire();
+    first.frame = buffers->frame(first.slot);
+    first_frame.copyTo(first.frame);
+  }
+  handoff.reset(new frame_queue(*buffers, policy, queue_capacity, max_age));
+
+/*the first frame goes out like any other, so replayed and synthetic sources start at their frame 0*/
+  first.timestamp = std::chrono::steady_clock::now();
+  first.frame_id = 0;
+  handoff->push(first);
+
+  running = true;
+  thread = std::thread(&capture_stream::run, this);
+  return true;
+}
+
+void capture_stream::stop() {
+  running = false;
+  source->shutdown();
+  if (handoff) { handoff->shutdown(); }
+  if (buffers) { buffers->shutdown(); }
+  if (thread.joinable()) { thread.join(); }
+}
+
+void capture_stream::run() {
+  traceThreadName("capture");
+  unsigned long frame_id = 1; //frame 0 was read by start()
+  bool const zero_copy = !own_buffers;
+  while (running) {
+    image_data capt_image;
+    if (zero_copy) {
+      {
+        TRACE_SCOPE("capture");
+        capt_image.slot = source->dequeue();
+      }
+      if (capt_image.slot >= 0) { capt_image.frame = buffers->frame(capt_image.slot); }
+      else if (buffers->isShutdown()) { break; }
+      capt_image.timestamp = std::chrono::steady_clock::now();
+      capt_image.frame_id = frame_id++;
+      if (!handoff->push(capt_image)) { break; }
+      if (capt_image.slot < 0) { break; } //the source has ended, the empty frame tells the main loop
+      continue;
+    }
+
+    {
+      TRACE_SCOPE("pool wait");
+      capt_image.slot = buffers->acquire(); //waits while every buffer is in use
+    }
+    if (capt_image.slot < 0) { break; }
+    capt_image.frame = buffers->frame(capt_image.slot); //capture straight into the pooled buffer
+    {
+      TRACE_SCOPE("capture");
+      source->read(capt_image.frame);
+    }
+    capt_image.timestamp = std::chrono::steady_clock::now();
+    capt_image.frame_id = frame_id++;
+/*an empty frame or a change of resolution leaves the pooled buffer unused*/
+    if (capt_image.frame.data != buffers->frame(capt_image.slot).data) {
+      buffers->release(capt_image.slot);
+      capt_image.slot = -1;
+    }
+    if (!handoff->push(capt_image)) { break; }
+  }
+}
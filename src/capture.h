@@ -0,0 +1,89 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "framequeue.h"
+
+/*something frames can be read from: a camera, a video file, ...*/
+class frame_source {
+public:
+  virtual ~frame_source() {}
+/*reads the next frame into the given buffer, which is only reallocated if the geometry differs;
+  an empty frame means the source has ended*/
+  virtual void read(cv::Mat& frame) = 0;
+
+/*zero-copy sources capture into buffers of their own: they lend the stream a pool over those
+  buffers (see frame_pool), and dequeue() waits for the next filled one, returning its slot, or -1
+  when the source has ended or the pool has been shut down*/
+  virtual frame_pool* ownBuffers() { return NULL; }
+  virtual int dequeue() { return -1; }
+
+/*playback controls, only sources that play a file can seek or change speed; both are safe to call
+  while another thread reads*/
+  virtual void seekBy(double /*seconds*/) {}
+  virtual void scaleSpeed(double /*factor*/) {}
+
+/*the nominal frames per second of the source, 0 if it does not know*/
+  virtual double frameRate() const { return 0; }
+
+/*ends the source from another thread, a read() waiting on it returns an empty frame*/
+  virtual void shutdown() {}
+};
+
+class opencv_source : public frame_source {
+public:
+  explicit opencv_source(std::string const& source);
+  bool isOpened() const { return capture.isOpened(); }
+  void read(cv::Mat& frame) override { capture >> frame; }
+  double frameRate() const override;
+
+private:
+  cv::VideoCapture capture;
+};
+
+/*opens a camera index, a video file (see playback.h), a synthetic source (see synth.h), a replay
+  (see replay.h) or a V4L2 device (see v4l2.h), returns nullptr on failure; video files play at
+  FILE_SPEED unless the source gives a speed of its own*/
+std::unique_ptr<frame_source> openFrameSource(std::string const& source, double file_speed = 1.0);
+/*parses the index of a stream among the given sources, which must be a non-negative integer*/
+bool parseStreamIndex(std::string const& spec, int& index);
+
+/*a frame source with its own capture thread, frame pool and handoff queue*/
+class capture_stream {
+public:
+  capture_stream(std::unique_ptr<frame_source> source, queue_policy policy, std::chrono::milliseconds max_age);
+  ~capture_stream();
+
+  capture_stream(const capture_stream&) = delete;
+  capture_stream& operator=(const capture_stream&) = delete;
+
+/*reads a first frame to size the frame pool, then starts the capture thread*/
+  bool start();
+  void stop();
+
+  cv::Size frameSize() const { return frame_size; }
+  frame_pool& pool() { return *buffers; }
+  frame_queue& queue() { return *handoff; }
+  frame_source& input() { return *source; }
+
+private:
+  void run();
+
+  std::unique_ptr<frame_source> source;
+  queue_policy const policy;
+  std::chrono::milliseconds const max_age;
+  cv::Size frame_size;
+
+  std::unique_ptr<frame_pool> own_buffers;
+  frame_pool* buffers = NULL; //our own or the source's
+  std::unique_ptr<frame_queue> handoff;
+  std::atomic<bool> running{false};
+  std::thread thread;
+};
+
+#endif //CAPTURE_H
@@ -8,22 +8,39 @@
 
 #include "globals.h"
 #include "rendering.h"
+#include "text.h"
+#include "edges.h"
+#include "scheduler.h"
+#include "trace.h"
 #include "input.h"
+#include "joystick.h"
+#include "hands.h"
+#include "pose.h"
+#include "capture.h"
+#include "recorder.h"
+#include "sessionlog.h"
+#include "replay.h"
 
 #ifndef DISABLE_DARKNET
 #include "darknet.h"
+#include "tracker.h"
 #endif
 
 #ifndef DISABLE_LEAPMOTION
 #include "leapfuncs.h"
 #endif
 
-struct image_data {
-  cv::Mat frame;
+/*what the main loop keeps for every capture stream*/
+struct stream_state {
+  image_data image; //newest frame taken from the stream
+  bool fresh = false; //the frame arrived in this iteration
+#ifndef DISABLE_DARKNET
+  detection_result detection;
+  std::vector<bbox_t> boxes; //what to show for the current frame
+#endif
 };
 
 Globals global;
-void edgeFilter(cv::Mat* image);
 void printHelp();
 
 /********************
@@ -34,7 +51,8 @@ void printHelp();
 
 int main(int argc, char* argv[]) {
 
-  std::string filename = "0";
+  std::vector<std::string> sources;
+  int record_stream = 0;
 //std::string names_file = "darknet/data/voc.names";
 //std::string cfg_file = "darknet/cfg/tiny-yolo-voc.cfg";
 //std::string weights_file = "darknet/tiny-yolo-voc.weights";
@@ -44,35 +62,160 @@ int main(int argc, char* argv[]) {
   std::string cfg_file = "darknet/cfg/yolo-voc.2.0.cfg";
   std::string weights_file = "darknet/yolo-voc_custom.weights";
 
-/*used for limiting clock speed*/
-  const int FPS = 30;
-  const int FRAME_DELAY = 1000 / FPS;
-  auto next_frame = std::chrono::steady_clock::now();
-
-  time_t rawtime;
+  time_t rawtime = 0, shown_time = 0;
   struct tm* timeinfo;
-  char timeText[10];
-  time(&rawtime);
-  timeinfo = localtime(&rawtime);
-  strftime(timeText, 80, "%H:%M:%S", timeinfo);
+  char timeText[10] = "";
 
 /*set default screen size*/
   int window_h = 1080;
   int window_w = 1920;
 
-  std::string out_videofile = "result.avi";
+  recorder_options recording;
+  std::string session_file;
+  std::string diff_file;
+
+  queue_policy frame_policy = queue_policy::latest;
+  std::chrono::milliseconds max_frame_age(100);
+
+  edge_detector edge_mode = edge_detector::canny;
+  pacing_mode pacing = pacing_mode::latency;
+  int input_rate = 500; //joystick samples per second, 0 samples once per frame
+  std::string joystick_device = defaultJoystickDevice();
+  std::string hand_record_file, hand_replay_file;
+  double hand_replay_speed = 1.0;
+  std::string pose_spec;
+  float camera_fov = 90.0f; //horizontal, degrees
+
+  std::string trace_file = "trace.json";
+  bool save_trace = false;
+  std::chrono::seconds trace_report_period(0);
+
+#ifndef DISABLE_DARKNET
+  tracker_options tracking;
+#endif
 
   int c;
-  while ((c = getopt(argc, argv, "hrs:w")) != -1) {
+  while ((c = getopt(argc, argv, "c:D:e:f:F:hi:J:k:K:l:L:o:p:P:q:Q:rR:s:S:t:T:w")) != -1) {
     switch (c) {
+      case 'c': //recording codec
+        recording.fourcc = optarg;
+        if (recording.fourcc.size() != 4) {
+          std::printf("A codec is given as a FourCC, not '%s'\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+#ifndef DISABLE_DARKNET
+      case 'D': //detection differences against a replayed session
+        diff_file = optarg;
+        break;
+#endif
+      case 'e': //edge detector
+        if (!parseEdgeDetector(optarg, edge_mode)) {
+          std::printf("Unknown edge detector '%s'\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'f': //camera field of view for reprojection
+        if (!parseFieldOfView(optarg, camera_fov)) {
+          std::printf("Invalid field of view '%s', give degrees between 0 and 180\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'F': //recording frame rate
+        if (!parseRecordFps(optarg, recording.fps)) {
+          std::printf("Invalid recording frame rate '%s', give a positive number of frames per second\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
       case 'h': //help
         printHelp();
         return EXIT_SUCCESS;
+      case 'i': //joystick sampling rate
+        if (!parseJoystickRate(optarg, input_rate)) {
+          std::printf("Invalid joystick sampling rate '%s', give samples per second up to 10000, or 0\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'J': //joystick device for the sampling thread
+        joystick_device = optarg;
+        break;
+#ifndef DISABLE_DARKNET
+      case 'k': //keyframe interval for tracking
+        if (!parseKeyframeInterval(optarg, tracking)) {
+          std::printf("Invalid keyframe interval '%s'\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'K': //maximum optical flow error
+        if (!parseMaxFlowError(optarg, tracking)) {
+          std::printf("Invalid optical flow error '%s'\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+#endif
+#ifndef DISABLE_LEAPMOTION
+      case 'l': //record the Leap Motion hands
+        hand_record_file = optarg;
+        break;
+#endif
+      case 'L': //replay recorded hands instead of using the device
+        if (!parseHandReplaySpec(optarg, hand_replay_file, hand_replay_speed)) {
+          std::printf("Invalid hand replay '%s'\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'o': //recording output file
+        recording.path = optarg;
+        break;
+      case 'p': //frame pacing
+        if (!parsePacingMode(optarg, pacing)) {
+          std::printf("Unknown pacing mode '%s'\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'P': //head pose source for reprojection
+        pose_spec = optarg;
+        break;
+      case 'q': //frame queueing policy
+        if (!parseQueuePolicy(optarg, frame_policy, max_frame_age)) {
+          std::printf("Unknown queueing policy '%s'\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'Q': //recording queue
+        if (!parseRecordPolicy(optarg, recording.policy, recording.queue_length)) {
+          std::printf("Unknown recording policy '%s'\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
       case 'r': //record
         global.flags.save_output_videofile = true;
         break;
-      case 's': //source
-        filename = optarg;
+      case 'R': //stream to record
+        if (!parseStreamIndex(optarg, record_stream)) {
+          std::printf("Invalid stream '%s', give its position among the sources from 0\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 's': //source, may be given several times or as a comma-separated list
+        for (std::stringstream list(optarg); list.good();) {
+          std::string source;
+          std::getline(list, source, ',');
+          if (!source.empty()) { sources.push_back(source); }
+        }
+        break;
+      case 'S': //session log
+        session_file = optarg;
+        break;
+      case 't': //trace output
+        trace_file = optarg;
+        save_trace = true;
+        break;
+      case 'T': //seconds between stage timing reports
+        if (!parseTraceReportPeriod(optarg, trace_report_period)) {
+          std::printf("Invalid report period '%s', give a whole number of seconds\n", optarg);
+          return EXIT_FAILURE;
+        }
         break;
       case 'w': //windowed
         global.flags.fullscreen = 0;
@@ -80,7 +223,7 @@ int main(int argc, char* argv[]) {
         window_w = 896;
         break;
       case '?':
-        if (optopt == 's') {
+        if (optopt == 'c' || optopt == 'D' || optopt == 'e' || optopt == 'f' || optopt == 'F' || optopt == 'o' || optopt == 'Q' || optopt == 'i' || optopt == 'J' || optopt == 'p' || optopt == 'P' || optopt == 's' || optopt == 'S' || optopt == 't' || optopt == 'T' || optopt == 'q' || optopt == 'k' || optopt == 'K' || optopt == 'l' || optopt == 'L' || optopt == 'R') {
           std::printf("Option -%c requires an argument.\n", optopt);
         } else if (isprint(optopt)) {
           std::printf("Unknown option '-%c'\n", optopt);
@@ -91,17 +234,43 @@ int main(int argc, char* argv[]) {
     }
   }
 
+  if (sources.empty()) { sources.push_back("0"); }
+  if (record_stream < 0 || record_stream >= static_cast<int>(sources.size())) {
+    std::printf("There is no stream %d to record\n", record_stream);
+    return EXIT_FAILURE;
+  }
+
 #ifndef DISABLE_DARKNET
   Detector detector(cfg_file, weights_file);
   auto object_names = objectNamesFromFile(names_file);
+  detection_stage detections(detector, static_cast<int>(sources.size()));
+  std::vector<flow_tracker> trackers(sources.size(), flow_tracker(tracking));
+  std::vector<overlay_instance> overlay;
+  std::vector<text_item> labels;
 #endif
+  std::vector<text_item> hud_text, text_items;
+  edge_overlay edges(edge_mode);
+
+/*hand frames from the device or a recording are smoothed and published to global.hands*/
+  hand_filter hand_smoothing;
+/*with the recorded timing the recording loops like a live device, unthrottled it plays once*/
+  hand_replay hand_playback(hand_replay_file, hand_smoothing, hand_replay_speed, hand_replay_speed > 0);
+  if (!hand_replay_file.empty() && !hand_playback.start()) {
+    std::printf("Failed to read hand recording %s\n", hand_replay_file.c_str());
+    return EXIT_FAILURE;
+  }
 
 #ifndef DISABLE_LEAPMOTION
+  std::unique_ptr<hand_recorder> hand_recording;
+  if (!hand_record_file.empty()) {
+    hand_recording.reset(new hand_recorder(hand_record_file, hand_smoothing));
+    if (!hand_recording->isOpen()) { std::printf("Failed to open %s for writing\n", hand_record_file.c_str()); return EXIT_FAILURE; }
+  }
   Leap::Controller leap_controller;
   leap_controller.setPolicy(Leap::Controller::POLICY_OPTIMIZE_HMD);
   leap_controller.enableGesture(Leap::Gesture::TYPE_SWIPE);
-  leap_event_listener listener;
-  leap_controller.addListener(listener);
+  leap_event_listener listener(hand_recording ? static_cast<hand_listener&>(*hand_recording) : hand_smoothing);
+  if (hand_replay_file.empty()) { leap_controller.addListener(listener); }
 #endif
 
 #ifndef DISABLE_OSVR
@@ -118,13 +287,32 @@ int main(int argc, char* argv[]) {
   }
 #endif
 
-  GLuint texture;
+/*the video and its HUD follow the head between capture and display when a pose source is given*/
+  std::unique_ptr<pose_source> poses;
+#ifndef DISABLE_OSVR
+  if (pose_spec == "osvr") { poses.reset(new osvr_pose_source(ctx)); }
+#endif
+  if (!poses && !pose_spec.empty()) {
+    poses = openScriptedPoseSource(pose_spec);
+    if (!poses) { std::printf("Unknown pose source '%s'\n", pose_spec.c_str()); return EXIT_FAILURE; }
+  }
+  std::unique_ptr<pose_reprojection> reprojection;
+  if (poses) { reprojection.reset(new pose_reprojection(*poses, camera_fov)); }
+
+  video_texture video;
+  bool video_shown = false; //the texture holds a frame
 
   if (!glfwInit() ) {
     std::fprintf(stderr, "Failed to initialize GLFW\n");
     return EXIT_FAILURE;
   }
 
+/*core profile: everything is drawn with shaders and static vertex buffers*/
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+
   GLFWwindow* window;
   window = glfwCreateWindow(window_w, window_h, "Window", NULL, NULL);
   if (window == NULL) {
@@ -142,128 +330,305 @@ int main(int argc, char* argv[]) {
   glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
   glfwSetKeyCallback(window, handleKey);
   glfwSetMouseButtonCallback(window, handleMouseButton);
+  glfwSetCursorPosCallback(window, handleCursor);
 
   if (glfwJoystickPresent(GLFW_JOYSTICK_1)) {
     global.flags.joystick_connected = true;
     std::printf("Joystick detected\n");
   }
 
+  joystick_poller joystick(joystick_device, input_rate);
+  if (input_rate > 0 && joystick.start()) {
+    global.flags.joystick_connected = true;
+    global.flags.joystick_polled = true;
+    std::printf("Sampling the joystick %s at %d Hz\n", joystick_device.c_str(), input_rate);
+  }
+
   glfwSwapInterval(1);
 
+/*pace compositing on the refresh rate of the monitor the window is shown on*/
+  GLFWmonitor* monitor = glfwGetWindowMonitor(window);
+  if (monitor == NULL) { monitor = glfwGetPrimaryMonitor(); }
+  const GLFWvidmode* video_mode = monitor ? glfwGetVideoMode(monitor) : NULL;
+  frame_scheduler scheduler(pacing, video_mode ? video_mode->refreshRate : 60);
+
+  if (!initRenderer(window_w, window_h)) {
+    std::fprintf(stderr, "Failed to initialize the renderer\n");
+    return EXIT_FAILURE;
+  }
+  if (!initText()) {
+    std::fprintf(stderr, "Failed to initialize text rendering\n");
+    return EXIT_FAILURE;
+  }
+
   glViewport(0, 0, window_w, window_h);
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  glOrtho(0.0, window_w, window_h, 0.0, 0.0, 100.0);
-  glMatrixMode(GL_MODELVIEW);
   glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
   glClearDepth(0.0f);
   glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
-  std::string file_ext = filename.substr(filename.find_last_of(".") + 1);
-
-  cv::VideoCapture capture;
-  if (file_ext == "avi" || file_ext == "mp4" || file_ext == "mpjg" || file_ext == "mov") {
-     capture.open(filename);
-  } else if (isdigit(filename[0])) {
-    capture.open(stoi(filename));
+/*every source gets its own capture thread and frame pool*/
+  std::vector<std::unique_ptr<capture_stream>> streams;
+  for (auto& source : sources) {
+    auto frames = openFrameSource(source);
+    if (!frames) { std::printf("Failed to open camera %s!\n", source.c_str()); return EXIT_FAILURE; }
+    streams.emplace_back(new capture_stream(std::move(frames), frame_policy, max_frame_age));
+    if (!streams.back()->start()) { std::printf("Failed to capture a frame from %s!\n", source.c_str()); return EXIT_FAILURE; }
   }
-  if (!capture.isOpened()) { std::printf("Failed to open camera!\n"); return EXIT_FAILURE; }
+  std::vector<stream_state> stream_states(streams.size());
 
-//capture.set(CV_CAP_PROP_FPS, 60);
-//capture.set(CV_CAP_PROP_FRAME_WIDTH, 1280);
-//capture.set(CV_CAP_PROP_FRAME_HEIGHT, 720);
+  cv::Size const frame_size = streams[0]->frameSize();
+  createVideoTexture(video, frame_size.width, frame_size.height);
 
-  cv::Mat capt_frame, gray_image, contours;
-
-  capture >> capt_frame;
-  if (capt_frame.empty()) { std::printf("Failed to capture a frame!\n"); return EXIT_FAILURE; }
-  cv::Size const frame_size = capt_frame.size();
-
-  image_data capt_image, pros_image;
-
-  tbb::concurrent_bounded_queue<image_data> image_queue;
-  image_queue.set_capacity(10);
-
-  global.kb_control_queue.set_capacity(5);
-  global.ms_control_queue.set_capacity(5);
+/*frames are encoded on their own thread, the main loop only copies them*/
+  video_recorder recorder(recording);
+  if (global.flags.save_output_videofile && !recorder.start(streams[record_stream]->frameSize())) {
+    std::printf("Failed to open %s for writing\n", recording.path.c_str());
+    return EXIT_FAILURE;
+  }
 
-  cv::VideoWriter output_video;
-  if (global.flags.save_output_videofile) {
-    output_video.open(out_videofile, CV_FOURCC('D','I','V','X'), std::max(35, 30), frame_size, true);
+/*raw frames, detections and input go to the session log without re-encoding anything*/
+  std::unique_ptr<session_writer> session;
+  std::vector<control_event> handled_events;
+#ifndef DISABLE_DARKNET
+  std::vector<session_box> session_boxes;
+#endif
+  if (!session_file.empty()) {
+    size_t largest_frame = 0;
+    for (auto& stream : streams) { largest_frame = std::max(largest_frame, static_cast<size_t>(stream->frameSize().area()) * 3); }
+    session.reset(new session_writer(session_file));
+    if (!session->open(largest_frame)) { std::printf("Failed to open %s for writing\n", session_file.c_str()); return EXIT_FAILURE; }
   }
 
-  std::thread t_capture;
-  t_capture = std::thread([&]() {
-    while(global.flags.is_running) {
-      if (image_queue.size() < 10) {
-        capture >> capt_frame;
-        capt_image.frame = capt_frame.clone();
-        image_queue.try_push(capt_image);
-      }
-    }
-  });
+/*when the first stream replays a session log, its input is played back and its detections compared*/
+  std::unique_ptr<session_replay> replayed;
+  std::ofstream diff_report;
+  std::string replay_path;
+  double replay_speed;
+  if (parseReplaySpec(sources[0], replay_path, replay_speed)) {
+    replayed.reset(new session_replay());
+    if (!replayed->open(replay_path)) { replayed.reset(); } //a video clip, nothing was recorded besides the frames
+  }
+  if (!diff_file.empty()) {
+    if (!replayed) { std::printf("-D needs a session log replayed by the first stream\n"); return EXIT_FAILURE; }
+    diff_report.open(diff_file);
+    if (!diff_report) { std::printf("Failed to open %s for writing\n", diff_file.c_str()); return EXIT_FAILURE; }
+  }
 
 /**************
 *  main loop  *
 **************/
 
+  traceThreadName("main");
   while (global.flags.is_running) {
 
-    next_frame += std::chrono::milliseconds(FRAME_DELAY);
-
+/*sleep until it is time to composite for the next vsync instead of spinning on empty queues*/
+    {
+      TRACE_SCOPE("sleep");
+      std::this_thread::sleep_until(scheduler.nextWake());
+    }
+    auto const composite_start = std::chrono::steady_clock::now();
 
-    handleEvents();
+    std::chrono::steady_clock::time_point input_time;
+    {
+      TRACE_SCOPE("events");
+      input_time = handleEvents(session ? &handled_events : NULL);
+      if (session) { session->addInput(handled_events); }
+    }
+/*keep a pose history to look up the head pose at capture time*/
+    if (reprojection) { reprojection->sample(); }
+    if (global.playback.seek != 0 || global.playback.speed_factor != 1) {
+      for (auto& stream : streams) {
+        if (global.playback.seek != 0) { stream->input().seekBy(global.playback.seek); }
+        if (global.playback.speed_factor != 1) { stream->input().scaleSpeed(global.playback.speed_factor); }
+      }
+      global.playback.seek = 0;
+      global.playback.speed_factor = 1;
+    }
 
-    if (!image_queue.empty()) {
-      image_queue.try_pop(pros_image);
+    for (size_t i = 0; i < streams.size(); i++) {
+      stream_state& state = stream_states[i];
+      image_data image;
+      TRACE_COUNTER("queue depth", static_cast<int>(i), streams[i]->queue().size());
+      state.fresh = streams[i]->queue().try_pop(image);
+      if (!state.fresh) { continue; }
+      streams[i]->pool().release(state.image.slot);
+      state.image = image;
+      TRACE_SPAN("queue wait", state.image.timestamp, std::chrono::steady_clock::now());
 
-      if (pros_image.frame.empty()) { std::printf("Video feed has ended\n"); global.flags.is_running = false; }
+      if (state.image.frame.empty()) { std::printf("Video feed %zu has ended\n", i); global.flags.is_running = false; continue; }
+      if (session) { session->addFrame(static_cast<int>(i), state.image.frame_id, state.image.timestamp, state.image.frame); }
+      if (replayed && i == 0) { replayed->replayInput(state.image.frame_id); }
 
 #ifndef DISABLE_DARKNET
-/*detect objects and draw a box around them*/
-      std::vector<bbox_t> result_vec = detector.detect(pros_image.frame);
-      drawBoxes(pros_image.frame, result_vec, object_names);
-//    showConsoleResult(result_vec, object_names);    //uncomment this if you want console feedback
+      int const stream = static_cast<int>(i);
+      flow_tracker& tracker = trackers[i];
+      TRACE_SCOPE("tracking");
+      if (tracker.enabled()) {
+/*detect on keyframes only and let optical flow carry the boxes in between*/
+        tracker.update(state.image);
+        if (tracker.keyframeDue(state.image) && detections.submit(stream, state.image)) { tracker.keyframeSubmitted(state.image); }
+        if (detections.latest(stream, state.detection)) { tracker.seed(state.detection); }
+        state.boxes = tracker.boxes();
+      } else {
+/*hand the newest frame to the detector if it is idle, and draw the most recent boxes it found*/
+        detections.submit(stream, state.image);
+        detections.latest(stream, state.detection);
+        state.boxes = state.detection.boxes;
+      }
+      if (session || (replayed && i == 0)) { toSessionBoxes(state.boxes, session_boxes); }
+      if (session) { session->addBoxes(static_cast<int>(i), state.image.frame_id, state.image.timestamp, session_boxes); }
+      if (replayed && i == 0) { replayed->compare(state.image.frame_id, session_boxes, diff_report.is_open() ? &diff_report : NULL); }
+//    showConsoleResult(state.detection.boxes, object_names);    //uncomment this if you want console feedback
 #endif
+    }
 
-      if (global.flags.edge_filter) { edgeFilter(&pros_image.frame); }
-      if (global.flags.display_time) {
-        time(&rawtime);
-        timeinfo = localtime(&rawtime);
-        strftime(timeText, 80, "%H:%M:%S", timeinfo);
+    global.display_stream %= static_cast<int>(streams.size());
+    stream_state& shown = stream_states[global.display_stream];
+    bool const fresh = shown.fresh && !shown.image.frame.empty();
+/*with reprojection the last frame is shown again at the newest head pose when no new one arrived*/
+    if (fresh || (reprojection && video_shown)) {
+      if (fresh) {
+        cv::Mat& frame = shown.image.frame;
+        scheduler.frameArrived(shown.image.timestamp);
+
+        if (global.flags.edge_filter) {
+          TRACE_SCOPE("edges");
+          edges.apply(frame, global.flags.edge_filter_ext);
+        }
 
-        putText(pros_image.frame, timeText, cv::Point(frame_size.width-230,frame_size.height-150), cv::FONT_HERSHEY_COMPLEX_SMALL, 0.8, cv::Scalar(0,255,0), 2);
+/*HUD text is drawn from cached sprites, the clock string only changes once a second*/
+        hud_text.clear();
+        if (global.flags.display_time) {
+          time(&rawtime);
+          if (rawtime != shown_time) {
+            shown_time = rawtime;
+            timeinfo = localtime(&rawtime);
+            strftime(timeText, sizeof(timeText), "%H:%M:%S", timeinfo);
+          }
+          hud_text.push_back(text_item{timeText, frame.cols-230.0f, frame.rows-150.0f, 0.8f, 0.0f, 1.0f, 0.0f});
+        }
+        if (global.flags.display_name) { hud_text.push_back(text_item{"player1", frame.cols/2.0f, 50.0f, 0.8f, 0.0f, 1.0f, 0.0f}); }
+
+/*upload the frame and its overlay once, then render them for every eye*/
+        {
+          TRACE_SCOPE("upload");
+          uploadVideoTexture(video, frame);
+        }
+        {
+          TRACE_SCOPE("overlay");
+#ifndef DISABLE_DARKNET
+          buildOverlay(shown.boxes, object_names, frame.size(), overlay, labels);
+          setOverlay(overlay, frame.cols, frame.rows);
+          text_items = labels;
+          text_items.insert(text_items.end(), hud_text.begin(), hud_text.end());
+#else
+          text_items = hud_text;
+#endif
+          setText(text_items, frame.cols, frame.rows);
+        }
+        if (reprojection) { reprojection->setFrameTime(shown.image.timestamp); }
+        video_shown = true;
       }
-      if (global.flags.display_name) { putText(pros_image.frame, "player1", cv::Point(frame_size.width/2, 50), cv::FONT_HERSHEY_COMPLEX_SMALL, 0.8, cv::Scalar(0,255,0), 2); }
-      if (global.flags.flip_image) { cv::flip(pros_image.frame, pros_image.frame, 0); }
 
-/*update and render video feed*/
+      {
+        TRACE_SCOPE("draw");
 #ifndef DISABLE_OSVR
-      ctx.update();
-      if (global.flags.fullscreen) { render(display, pros_image.frame, texture, window_w, window_h); }
-      else {
-        glViewport(0, 0, window_w, window_h);
-        drawToGLFW(pros_image.frame, texture, window_w, window_h);
-      }
+        ctx.update();
+        if (global.flags.fullscreen) { render(display, video, window_w, window_h, reprojection.get()); }
+        else {
+          glViewport(0, 0, window_w, window_h);
+          if (reprojection) { reprojection->latch(window_w, window_h); }
+          drawToGLFW(video, window_w, window_h);
+          drawOverlay(window_w, window_h);
+          drawText(window_w, window_h);
+        }
 #else
-      glViewport(0, 0, window_w, window_h);
-      drawToGLFW(pros_image.frame, texture, window_w, window_h);
+        glViewport(0, 0, window_w, window_h);
+        if (reprojection) { reprojection->latch(window_w, window_h); }
+        drawToGLFW(video, window_w, window_h);
+        drawOverlay(window_w, window_h);
+        drawText(window_w, window_h);
 #endif
+      }
+      auto const submitted = std::chrono::steady_clock::now();
       glfwSwapBuffers(window);
-      glfwPollEvents();
-
-      if (output_video.isOpened() && global.flags.save_output_videofile) {
-        output_video << pros_image.frame;
+      auto const swapped = std::chrono::steady_clock::now();
+      TRACE_SPAN("swap", submitted, swapped);
+/*the swap returns once the frame showing the effects of this input is on its way to the display*/
+      if (input_time != std::chrono::steady_clock::time_point()) { TRACE_SPAN("input to photon", input_time, swapped); }
+      scheduler.presented(composite_start, submitted, swapped);
+    } else {
+      scheduler.skipped();
+    }
+    glfwPollEvents();
+
+    stream_state& recorded = stream_states[record_stream];
+    if (recorded.fresh && !recorded.image.frame.empty() && recorder.isOpen() && global.flags.save_output_videofile) {
+      TRACE_SCOPE("record");
+      int const slot = recorder.acquire();
+      if (slot >= 0) {
+        cv::Mat copy = recorder.frame(slot);
+        recorded.image.frame.copyTo(copy);
+#ifndef DISABLE_DARKNET
+/*the display gets its boxes from the overlay, only the recording needs them in the pixels*/
+        drawBoxes(copy, recorded.boxes, object_names);
+#endif
+        if (&recorded == &shown) { burnText(copy, hud_text); }
+        recorder.push(slot, recorded.image.timestamp);
       }
     }
 
-/*slow down to 30FPS if running faster*/
-    std::this_thread::sleep_until(next_frame);
+    if (global.flags.dump_trace) {
+      global.flags.dump_trace = false;
+      if (traceDump(trace_file)) { std::printf("Trace written to %s\n", trace_file.c_str()); }
+    }
+    traceReport(trace_report_period);
 
   } //main loop
 
-  if (t_capture.joinable()) { t_capture.join(); }
+  if (save_trace && !traceDump(trace_file)) { std::printf("Failed to write the trace to %s\n", trace_file.c_str()); }
 
+#ifndef DISABLE_DARKNET
+  detections.stop();
+  std::printf("Detection: %lu frames in %lu batches\n", detections.frames(), detections.batches());
+#endif
+  std::printf("Display: %lu frames at %.0f Hz, cadence %d, %lu missed deadlines (%.1f%%)\n",
+              scheduler.presentedFrames(), scheduler.refreshRate(), scheduler.cadence(),
+              scheduler.missedDeadlines(), 100.0 * scheduler.missRate());
+  if (reprojection) { std::printf("Reprojection: %lu pose latches, largest shift %.0f pixels\n", reprojection->latches(), reprojection->maxShift()); }
+  if (global.input_events.dropped() > 0) { std::printf("Input: %lu events dropped\n", global.input_events.dropped()); }
+  for (size_t i = 0; i < streams.size(); i++) {
+    streams[i]->stop();
+    auto const pool_stats = streams[i]->pool().stats();
+    std::printf("Stream %zu: %d buffers, peak %d in use, %lu frames captured, %lu starved, %lu dropped\n",
+                i, pool_stats.count, pool_stats.peak_in_use, pool_stats.acquired, pool_stats.starved,
+                streams[i]->queue().dropped());
+  }
+
+  if (recorder.isOpen()) {
+    recorder.stop();
+    std::printf("Recording: %lu frames submitted, %lu dropped, %lu written (%lu repeated, %lu merged, %lu gap slots skipped) to %s\n",
+                recorder.submitted(), recorder.dropped(), recorder.written(), recorder.repeated(), recorder.merged(),
+                recorder.skipped(), recording.path.c_str());
+  }
+#ifndef DISABLE_DARKNET
+  if (replayed) {
+    auto const diff = replayed->stats();
+    std::printf("Replay: %lu frames compared, %lu differ (%lu boxes matched, %lu missing, %lu extra)\n",
+                diff.frames, diff.differing, diff.matched, diff.missing, diff.extra);
+  }
+#endif
+  if (session) {
+    session->close();
+    std::printf("Session log: %lu frames, %lu records dropped, %.1f MB written to %s\n",
+                session->frames(), session->dropped(), session->bytes() / 1e6, session_file.c_str());
+  }
+  joystick.stop();
+  if (global.flags.joystick_polled) { std::printf("Joystick: %lu samples\n", joystick.samples()); }
+  hand_playback.stop();
+  destroyVideoTexture(video);
+  destroyText();
+  destroyRenderer();
   glfwTerminate();
 
   cv::destroyAllWindows();
@@ -282,26 +647,6 @@ int main(int argc, char* argv[]) {
 *                   *
 ********************/
 
-void edgeFilter(cv::Mat* image) {
-
-  cv::Mat src_gray, canny_output;
-  std::vector<std::vector<cv::Point>> contours;
-  std::vector<cv::Vec4i> hierarchy;
-  cvtColor(*image, src_gray, CV_BGR2GRAY);
-  cv::blur(src_gray, src_gray, cv::Size(3,3));
-
-  cv::Canny(src_gray, canny_output, 30, 120, 3);
-
-  cv::findContours(canny_output, contours, hierarchy, CV_RETR_TREE, CV_CHAIN_APPROX_SIMPLE, cv::Point(0,0));
-
-  if (global.flags.edge_filter_ext) { *image = cv::Scalar(0,0,0); }
-
-  for (unsigned int i = 0; i < contours.size(); i++) {
-    cv::Scalar color = cv::Scalar(0,255,0);
-    cv::drawContours(*image, contours, i, color, 1, 8, hierarchy, 0, cv::Point());
-  }
-}
-
 void printHelp() {
   std::printf("help\n");
 }
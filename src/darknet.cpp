@@ -6,9 +6,156 @@
 
 #include "globals.h"
 #include "darknet.h"
+#include "rendering.h"
+#include "text.h"
+#include "sessionlog.h"
+#include "trace.h"
 
-void drawBoxes(cv::Mat mat_img, std::vector<bbox_t> result_vec, std::vector<std::string> object_names) {
-  int const colors[6][3] = { {1,0,1},{0,0,1},{0,1,1},{0,1,0},{1,1,0},{1,0,0} };
+detection_stage::detection_stage(Detector& detector, int stream_count, std::chrono::milliseconds batch_window)
+  : detector(detector), batch_window(batch_window) {
+  for (int i = 0; i < stream_count; i++) {
+    streams.emplace_back(new stream_input(detector.get_net_width(), detector.get_net_height()));
+  }
+  worker = std::thread(&detection_stage::run, this);
+}
+
+detection_stage::~detection_stage() {
+  stop();
+}
+
+bool detection_stage::submit(int stream, image_data const& frame) {
+  stream_input& in = *streams[stream];
+  if (frame.frame.empty() || in.busy) { return false; }
+
+/*the worker is done with this stream, so its frame buffer is ours until we hand it over; a copy
+  into the same buffer every time is all the main loop pays, the worker resizes it*/
+  {
+    TRACE_SCOPE("copy");
+    frame.frame.copyTo(in.frame);
+  }
+  in.frame_size = frame.frame.size();
+  in.frame_id = frame.frame_id;
+  in.timestamp = frame.timestamp;
+  in.busy = true;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    in.pending = true;
+  }
+  wakeup.notify_one();
+  return true;
+}
+
+bool detection_stage::latest(int stream, detection_result& latest_result) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  stream_input const& in = *streams[stream];
+  if (!in.completed) { return false; }
+  latest_result = in.result;
+  return true;
+}
+
+void detection_stage::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wakeup.notify_one();
+  if (worker.joinable()) { worker.join(); }
+}
+
+bool detection_stage::anyPending() const {
+  for (auto& i : streams) { if (i->pending) { return true; } }
+  return false;
+}
+
+bool detection_stage::allPending() const {
+  for (auto& i : streams) { if (!i->pending) { return false; } }
+  return true;
+}
+
+void detection_stage::run() {
+  std::vector<int> batch;
+  std::vector<std::vector<bbox_t>> boxes(streams.size());
+
+  traceThreadName("detection");
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    wakeup.wait(lock, [&] { return stopping || anyPending(); });
+/*give the other streams a moment to deliver their frames so they share this pass*/
+    wakeup.wait_for(lock, batch_window, [&] { return stopping || allPending(); });
+    if (stopping) { break; }
+
+    batch.clear();
+    for (size_t i = 0; i < streams.size(); i++) {
+      if (streams[i]->pending) {
+        streams[i]->pending = false;
+        batch.push_back(static_cast<int>(i));
+      }
+    }
+    lock.unlock();
+
+/*the detector library has no multi-image entry point, so the batch is run back to back*/
+    for (int i : batch) {
+      image_t const* input;
+      {
+        TRACE_SCOPE("resize");
+        streams[i]->input.resize(streams[i]->frame);
+      }
+      {
+        TRACE_SCOPE("preprocess");
+        input = &streams[i]->input.convert();
+      }
+      TRACE_SCOPE("detect");
+      boxes[i] = detector.detect_resized(*input, streams[i]->frame_size);
+    }
+
+    lock.lock();
+    for (int i : batch) {
+      stream_input& in = *streams[i];
+      in.result.boxes.swap(boxes[i]);
+      in.result.frame_id = in.frame_id;
+      in.result.timestamp = in.timestamp;
+      in.completed = true;
+      in.busy = false;
+    }
+    batch_count++;
+    frame_count += batch.size();
+  }
+}
+
+static overlay_instance makeInstance(float x, float y, float w, float h, cv::Scalar const& color, overlay_shape shape, float thickness) {
+  return overlay_instance{x, y, w, h,
+                          static_cast<float>(color[2] / 255.0), static_cast<float>(color[1] / 255.0), static_cast<float>(color[0] / 255.0), 1.0f,
+                          static_cast<float>(shape), thickness};
+}
+
+void buildOverlay(std::vector<bbox_t> const& result_vec, std::vector<std::string> const& object_names, cv::Size frame_size,
+                  std::vector<overlay_instance>& instances, std::vector<text_item>& labels) {
+  instances.clear();
+  labels.clear();
+  for (auto &i : result_vec) {
+    if (object_names.size() <= i.obj_id) { continue; }
+    cv::Scalar const color = objectIdToColor(i.obj_id);
+    std::string const& obj_name = object_names[i.obj_id];
+    if (obj_name == "head") {
+      float const radius = i.h / 2.0f;
+      instances.push_back(makeInstance(i.x + i.w / 2.0f - radius, i.y, 2 * radius, 2 * radius, color, OVERLAY_CIRCLE, 2));
+    } else {
+      instances.push_back(makeInstance(i.x, i.y, i.w, i.h, color, OVERLAY_RECTANGLE, 5));
+/*the label and its background, laid out like drawBoxes() burns them in*/
+      std::string label = obj_name;
+      if (i.track_id > 0) { label += " - " + std::to_string(i.track_id); }
+      int const max_width = std::max(measureText(label, 1.2), static_cast<int>(i.w) + 2);
+      float const left = std::max(static_cast<int>(i.x) - 3, 0), top = std::max(static_cast<int>(i.y) - 30, 0);
+      float const right = std::min(static_cast<int>(i.x) + max_width, frame_size.width - 1);
+      float const bottom = std::min(static_cast<int>(i.y), frame_size.height - 1);
+      instances.push_back(makeInstance(left, top, right - left, bottom - top, color, OVERLAY_FILL, 0));
+      labels.push_back(text_item{std::move(label), static_cast<float>(i.x), static_cast<float>(i.y) - 10, 1.2f, 0.0f, 0.0f, 0.0f});
+    }
+  }
+}
+
+void drawBoxes(cv::Mat& mat_img, std::vector<bbox_t> const& result_vec, std::vector<std::string> const& object_names) {
   for (auto &i : result_vec) {
     cv::Scalar color = objectIdToColor(i.obj_id);
     if (object_names.size() > i.obj_id) {
@@ -17,8 +164,7 @@ void drawBoxes(cv::Mat mat_img, std::vector<bbox_t> result_vec, std::vector<std:
       else {
         cv::rectangle(mat_img, cv::Rect(i.x, i.y, i.w, i.h), color, 5);
         if (i.track_id > 0) { obj_name += " - " + std::to_string(i.track_id); }
-        cv::Size const text_size = getTextSize(obj_name, cv::FONT_HERSHEY_COMPLEX_SMALL, 1.2, 2, 0);
-        int const max_width = (text_size.width > i.w + 2) ? text_size.width : (i.w + 2);
+        int const max_width = std::max(measureText(obj_name, 1.2), static_cast<int>(i.w) + 2);
         cv::rectangle(mat_img, cv::Point2f(std::max((int)i.x - 3, 0), std::max((int)i.y - 30, 0)), cv::Point2f(std::min((int)i.x + max_width, mat_img.cols - 1), std::min((int)i.y, mat_img.rows - 1)), color, CV_FILLED, 8, 0);
         putText(mat_img, obj_name, cv::Point2f(i.x, i.y -10), cv::FONT_HERSHEY_COMPLEX_SMALL, 1.2, cv::Scalar(0,0,0), 2);
       }
@@ -26,6 +172,11 @@ void drawBoxes(cv::Mat mat_img, std::vector<bbox_t> result_vec, std::vector<std:
   }
 }
 
+void toSessionBoxes(std::vector<bbox_t> const& boxes, std::vector<session_box>& out) {
+  out.clear();
+  for (auto const& b : boxes) { out.push_back(session_box{b.x, b.y, b.w, b.h, b.prob, b.obj_id, b.track_id, b.frames_counter}); }
+}
+
 cv::Scalar objectIdToColor(int obj_id) {
   int const colors[6][3] = { {1,0,1},{0,0,1},{0,1,1},{0,1,0},{1,1,0},{1,0,0} };
   int const offset = obj_id * 123457 % 6;
@@ -8,9 +8,75 @@
 #define DARKNET_H
 
 #include "yolo_v2_class.hpp"
+#include "preprocess.h"
+#include "framequeue.h"
 
-void drawBoxes(cv::Mat mat_img, std::vector<bbox_t> result_vec, std::vector<std::string> object_names);
+struct detection_result {
+  std::vector<bbox_t> boxes;
+  unsigned long frame_id = 0; //the frame the boxes were detected in
+  std::chrono::steady_clock::time_point timestamp; //capture time of that frame
+};
+
+/*runs the detector on its own thread so that inference does not limit the display rate;
+  frames from several streams that arrive within the batch window are processed in one pass*/
+class detection_stage {
+public:
+  detection_stage(Detector& detector, int stream_count = 1,
+                  std::chrono::milliseconds batch_window = std::chrono::milliseconds(5));
+  ~detection_stage();
+
+  detection_stage(const detection_stage&) = delete;
+  detection_stage& operator=(const detection_stage&) = delete;
+
+/*hands the frame to the worker if the stream's previous frame is done, returns false if it is still busy*/
+  bool submit(int stream, image_data const& frame);
+/*copies the most recent completed result of the stream, returns false if nothing has completed yet*/
+  bool latest(int stream, detection_result& result) const;
+  void stop();
+
+  unsigned long batches() const { return batch_count.load(); }
+  unsigned long frames() const { return frame_count.load(); }
+
+private:
+  struct stream_input {
+    stream_input(int width, int height) : input(width, height) {}
+    cv::Mat frame; //a copy of the submitted frame, the main loop keeps drawing into its own
+    detector_input input; //the frame resized to the network input size, only touched by the worker
+    cv::Size frame_size;
+    unsigned long frame_id = 0;
+    std::chrono::steady_clock::time_point timestamp;
+    std::atomic<bool> busy{false};
+    bool pending = false, completed = false;
+    detection_result result;
+  };
+
+  void run();
+  bool anyPending() const;
+  bool allPending() const;
+
+  Detector& detector;
+  std::chrono::milliseconds const batch_window;
+  std::vector<std::unique_ptr<stream_input>> streams;
+
+  mutable std::mutex mutex;
+  std::condition_variable wakeup;
+  bool stopping = false;
+  std::atomic<unsigned long> batch_count{0}, frame_count{0};
+  std::thread worker;
+};
+
+struct overlay_instance;
+struct text_item;
+struct session_box;
+
+/*turns detections into GPU overlay primitives and label strings in frame coordinates*/
+void buildOverlay(std::vector<bbox_t> const& result_vec, std::vector<std::string> const& object_names, cv::Size frame_size,
+                  std::vector<overlay_instance>& instances, std::vector<text_item>& labels);
+/*burns the detections into the frame pixels, for recordings*/
+void drawBoxes(cv::Mat& mat_img, std::vector<bbox_t> const& result_vec, std::vector<std::string> const& object_names);
 void showConsoleResult(std::vector<bbox_t> const result_vec, std::vector<std::string> const object_names);
+/*the detections in the fixed layout of session logs*/
+void toSessionBoxes(std::vector<bbox_t> const& boxes, std::vector<session_box>& out);
 cv::Scalar objectIdToColor(int obj_id);
 std::vector<std::string> objectNamesFromFile(std::string const filename);
 
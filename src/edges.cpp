@@ -0,0 +1,176 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "edges.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+/*the same thresholds edgeFilter() used, the Sobel mask cuts at the upper one*/
+static const double CANNY_LOW = 30;
+static const double CANNY_HIGH = 120;
+static const int SOBEL_THRESHOLD = 120;
+
+/*rows per task, small enough to balance across cores and large enough to amortize the scheduling*/
+static const int STRIPE_ROWS = 32;
+
+bool parseEdgeDetector(std::string const& spec, edge_detector& detector) {
+  if (spec == "canny") { detector = edge_detector::canny; }
+  else if (spec == "sobel") { detector = edge_detector::sobel; }
+  else { return false; }
+  return true;
+}
+
+/*marks the pixels of row y whose L1 Sobel gradient exceeds the threshold, like Canny's default norm*/
+static void sobelRowScalar(const unsigned char* above, const unsigned char* row, const unsigned char* below, int from, int to, unsigned char* mask) {
+  for (int x = from; x < to; x++) {
+    int const gx = (above[x+1] - above[x-1]) + 2*(row[x+1] - row[x-1]) + (below[x+1] - below[x-1]);
+    int const gy = (below[x-1] + 2*below[x] + below[x+1]) - (above[x-1] + 2*above[x] + above[x+1]);
+    mask[x] = (std::abs(gx) + std::abs(gy) > SOBEL_THRESHOLD) ? 255 : 0;
+  }
+}
+
+/*paints masked pixels green and keeps or blacks out the rest*/
+static void blendRowScalar(const unsigned char* mask, unsigned char* bgr, int width, bool edges_only) {
+  for (int x = 0; x < width; x++) {
+    unsigned char* pixel = bgr + x*3;
+    if (mask[x]) { pixel[0] = 0; pixel[1] = 255; pixel[2] = 0; }
+    else if (edges_only) { pixel[0] = 0; pixel[1] = 0; pixel[2] = 0; }
+  }
+}
+
+#ifdef HAVE_X86_SIMD
+
+__attribute__((target("ssse3")))
+static inline __m128i loadWidened(const unsigned char* src) {
+  return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src)), _mm_setzero_si128());
+}
+
+/*eight pixels per step in 16-bit lanes, |gx| + |gy| tops out at 2040 so nothing overflows*/
+__attribute__((target("ssse3")))
+static void sobelRowSSE(const unsigned char* above, const unsigned char* row, const unsigned char* below, int from, int to, unsigned char* mask) {
+  __m128i const threshold = _mm_set1_epi16(SOBEL_THRESHOLD);
+  int x = from;
+  for (; x + 8 <= to; x += 8) {
+    __m128i const a0 = loadWidened(above + x - 1), a1 = loadWidened(above + x), a2 = loadWidened(above + x + 1);
+    __m128i const r0 = loadWidened(row + x - 1), r2 = loadWidened(row + x + 1);
+    __m128i const b0 = loadWidened(below + x - 1), b1 = loadWidened(below + x), b2 = loadWidened(below + x + 1);
+
+    __m128i const gx = _mm_add_epi16(_mm_add_epi16(_mm_sub_epi16(a2, a0), _mm_sub_epi16(b2, b0)),
+                                     _mm_slli_epi16(_mm_sub_epi16(r2, r0), 1));
+    __m128i const gy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(b0, b2), _mm_slli_epi16(b1, 1)),
+                                     _mm_add_epi16(_mm_add_epi16(a0, a2), _mm_slli_epi16(a1, 1)));
+    __m128i const edge = _mm_cmpgt_epi16(_mm_add_epi16(_mm_abs_epi16(gx), _mm_abs_epi16(gy)), threshold);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(mask + x), _mm_packs_epi16(edge, edge));
+  }
+  sobelRowScalar(above, row, below, x, to, mask);
+}
+
+/*spreads 16 mask bytes over the 48 bytes of the matching BGR pixels and selects green or the source*/
+__attribute__((target("ssse3")))
+static void blendRowSSE(const unsigned char* mask, unsigned char* bgr, int width, bool edges_only) {
+  __m128i const spread0 = _mm_setr_epi8( 0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+  __m128i const spread1 = _mm_setr_epi8( 5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9,10,10);
+  __m128i const spread2 = _mm_setr_epi8(10,11,11,11,12,12,12,13,13,13,14,14,14,15,15,15);
+  __m128i const green0 = _mm_setr_epi8(0,-1,0,0,-1,0,0,-1,0,0,-1,0,0,-1,0,0);
+  __m128i const green1 = _mm_setr_epi8(-1,0,0,-1,0,0,-1,0,0,-1,0,0,-1,0,0,-1);
+  __m128i const green2 = _mm_setr_epi8(0,0,-1,0,0,-1,0,0,-1,0,0,-1,0,0,-1,0);
+  __m128i const keep = edges_only ? _mm_setzero_si128() : _mm_set1_epi8(-1);
+
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i const m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask + x));
+    __m128i* const out = reinterpret_cast<__m128i*>(bgr + x*3);
+    __m128i const m0 = _mm_shuffle_epi8(m, spread0);
+    __m128i const m1 = _mm_shuffle_epi8(m, spread1);
+    __m128i const m2 = _mm_shuffle_epi8(m, spread2);
+    __m128i const p0 = _mm_and_si128(_mm_loadu_si128(out), keep);
+    __m128i const p1 = _mm_and_si128(_mm_loadu_si128(out + 1), keep);
+    __m128i const p2 = _mm_and_si128(_mm_loadu_si128(out + 2), keep);
+    _mm_storeu_si128(out,     _mm_or_si128(_mm_and_si128(m0, green0), _mm_andnot_si128(m0, p0)));
+    _mm_storeu_si128(out + 1, _mm_or_si128(_mm_and_si128(m1, green1), _mm_andnot_si128(m1, p1)));
+    _mm_storeu_si128(out + 2, _mm_or_si128(_mm_and_si128(m2, green2), _mm_andnot_si128(m2, p2)));
+  }
+  blendRowScalar(mask + x, bgr + x*3, width - x, edges_only);
+}
+
+#endif //HAVE_X86_SIMD
+
+typedef void (*sobel_row_fn)(const unsigned char*, const unsigned char*, const unsigned char*, int, int, unsigned char*);
+typedef void (*blend_row_fn)(const unsigned char*, unsigned char*, int, bool);
+
+static bool useSSE() {
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("ssse3");
+#else
+  return false;
+#endif
+}
+
+static sobel_row_fn selectSobelRow() {
+#ifdef HAVE_X86_SIMD
+  if (useSSE()) { return sobelRowSSE; }
+#endif
+  return sobelRowScalar;
+}
+
+static blend_row_fn selectBlendRow() {
+#ifdef HAVE_X86_SIMD
+  if (useSSE()) { return blendRowSSE; }
+#endif
+  return blendRowScalar;
+}
+
+/*runs body(first_row, last_row) over the frame in stripes; every call is a barrier*/
+template <typename Body>
+static void forEachStripe(int rows, Body const& body) {
+  tbb::parallel_for(tbb::blocked_range<int>(0, rows, STRIPE_ROWS),
+                    [&](tbb::blocked_range<int> const& range) { body(range.begin(), range.end()); });
+}
+
+void edge_overlay::apply(cv::Mat& frame, bool edges_only) {
+  static const sobel_row_fn sobel_row = selectSobelRow();
+  static const blend_row_fn blend_row = selectBlendRow();
+
+  if (frame.empty() || frame.type() != CV_8UC3) { return; }
+  int const rows = frame.rows;
+  int const cols = frame.cols;
+  gray.create(frame.size(), CV_8UC1);
+  blurred.create(frame.size(), CV_8UC1);
+  mask.create(frame.size(), CV_8UC1);
+
+  forEachStripe(rows, [&](int first, int last) {
+    cv::Mat stripe = gray.rowRange(first, last);
+    cv::cvtColor(frame.rowRange(first, last), stripe, cv::COLOR_BGR2GRAY);
+  });
+
+/*a filter on a row range reads the neighbouring rows as its border, so the stripes blur seamlessly*/
+  forEachStripe(rows, [&](int first, int last) {
+    cv::Mat stripe = blurred.rowRange(first, last);
+    cv::blur(gray.rowRange(first, last), stripe, cv::Size(3,3));
+  });
+
+/*hysteresis follows edges across the whole image, so Canny runs on the frame (OpenCV threads it itself)*/
+  if (detector == edge_detector::canny) { cv::Canny(blurred, mask, CANNY_LOW, CANNY_HIGH, 3); }
+
+  forEachStripe(rows, [&](int first, int last) {
+    for (int y = first; y < last; y++) {
+      unsigned char* mask_row = mask.ptr<unsigned char>(y);
+      if (detector == edge_detector::sobel) {
+        std::memset(mask_row, 0, cols);
+        if (y > 0 && y < rows - 1 && cols > 2) {
+          sobel_row(blurred.ptr<unsigned char>(y - 1), blurred.ptr<unsigned char>(y), blurred.ptr<unsigned char>(y + 1),
+                    1, cols - 1, mask_row);
+        }
+      }
+      blend_row(mask_row, frame.ptr<unsigned char>(y), cols, edges_only);
+    }
+  });
+}
@@ -0,0 +1,28 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef EDGES_H
+#define EDGES_H
+
+enum class edge_detector {canny, sobel};
+
+/*parses "canny" or "sobel"*/
+bool parseEdgeDetector(std::string const& spec, edge_detector& detector);
+
+/*draws the edges of a frame over it, or over black in edges-only mode;
+  the work is split into row stripes across cores and costs the same however busy the scene is*/
+class edge_overlay {
+public:
+  explicit edge_overlay(edge_detector detector = edge_detector::canny) : detector(detector) {}
+
+  void apply(cv::Mat& frame, bool edges_only);
+
+private:
+  edge_detector detector;
+  cv::Mat gray, blurred, mask;
+};
+
+#endif //EDGES_H
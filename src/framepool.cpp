@@ -0,0 +1,76 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "framepool.h"
+
+frame_pool::frame_pool(int count, cv::Size size, int type) {
+  size_t const page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t const frame_bytes = static_cast<size_t>(size.area()) * CV_ELEM_SIZE(type);
+
+  free_slots.set_capacity(count);
+  for (int i = 0; i < count; i++) {
+    void* buffer = NULL;
+    if (posix_memalign(&buffer, page_size, frame_bytes) != 0) { throw std::bad_alloc(); }
+    buffers.push_back(buffer);
+    frames.emplace_back(size, type, buffer);
+    free_slots.push(i);
+  }
+}
+
+frame_pool::frame_pool(std::vector<cv::Mat> const& external, std::function<void(int)> release_hook)
+  : frames(external), release_hook(release_hook) {}
+
+frame_pool::~frame_pool() {
+  frames.clear();
+  for (auto buffer : buffers) { std::free(buffer); }
+}
+
+int frame_pool::taken(int slot) {
+  acquired++;
+  int const now_in_use = ++in_use;
+  int peak = peak_in_use.load(std::memory_order_relaxed);
+  while (now_in_use > peak && !peak_in_use.compare_exchange_weak(peak, now_in_use)) {}
+  return slot;
+}
+
+int frame_pool::acquire() {
+  int slot;
+  if (!free_slots.try_pop(slot)) {
+    starved++;
+    try {
+      free_slots.pop(slot);
+    } catch (tbb::user_abort&) {
+      return -1;
+    }
+  }
+  return taken(slot);
+}
+
+int frame_pool::tryAcquire() {
+  int slot;
+  if (!free_slots.try_pop(slot)) {
+    starved++;
+    return -1;
+  }
+  return taken(slot);
+}
+
+void frame_pool::release(int slot) {
+  if (slot < 0) { return; }
+  in_use--;
+  if (release_hook) { release_hook(slot); }
+  else { free_slots.try_push(slot); }
+}
+
+void frame_pool::shutdown() {
+  is_shutdown = true;
+  free_slots.abort();
+}
+
+frame_pool::counters frame_pool::stats() const {
+  return counters{count(), in_use.load(), peak_in_use.load(), acquired.load(), starved.load()};
+}
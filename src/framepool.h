@@ -0,0 +1,56 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+/*a fixed set of page-aligned frame buffers recycled between the capture and processing threads*/
+class frame_pool {
+public:
+  frame_pool(int count, cv::Size size, int type = CV_8UC3);
+/*a pool over buffers it does not own, e.g. memory mapped driver buffers; they are filled outside
+  the pool and announced with claim(), and every release() calls the hook instead of freeing the slot*/
+  frame_pool(std::vector<cv::Mat> const& external, std::function<void(int)> release_hook);
+  ~frame_pool();
+
+  frame_pool(const frame_pool&) = delete;
+  frame_pool& operator=(const frame_pool&) = delete;
+
+/*blocks until a buffer is free, returns -1 once the pool has been shut down*/
+  int acquire();
+/*returns -1 right away if no buffer is free*/
+  int tryAcquire();
+/*marks an external buffer that has just been filled as in use*/
+  int claim(int slot) { return taken(slot); }
+  void release(int slot);
+  void shutdown();
+  bool isShutdown() const { return is_shutdown.load(); }
+
+  cv::Mat const& frame(int slot) const { return frames[slot]; }
+  int count() const { return static_cast<int>(frames.size()); }
+  int occupancy() const { return in_use.load(std::memory_order_relaxed); }
+
+  struct counters {
+    int count, in_use, peak_in_use;
+    unsigned long acquired, starved;
+  };
+  counters stats() const;
+
+private:
+  int taken(int slot);
+
+  std::vector<void*> buffers;
+  std::vector<cv::Mat> frames;
+  tbb::concurrent_bounded_queue<int> free_slots;
+  std::function<void(int)> release_hook;
+  std::atomic<bool> is_shutdown{false};
+  std::atomic<int> in_use{0};
+  std::atomic<int> peak_in_use{0};
+  std::atomic<unsigned long> acquired{0};
+  std::atomic<unsigned long> starved{0};
+};
+
+#endif //FRAMEPOOL_H
@@ -0,0 +1,103 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "framequeue.h"
+
+bool parseQueuePolicy(std::string const& spec, queue_policy& policy, std::chrono::milliseconds& max_age) {
+  if (spec == "latest") { policy = queue_policy::latest; return true; }
+  if (spec == "fifo") { policy = queue_policy::fifo; return true; }
+  if (spec.compare(0, 4, "age:") == 0) {
+    int const ms = std::atoi(spec.c_str() + 4);
+    if (ms <= 0) { return false; }
+    policy = queue_policy::max_age;
+    max_age = std::chrono::milliseconds(ms);
+    return true;
+  }
+  return false;
+}
+
+frame_queue::frame_queue(frame_pool& pool, queue_policy policy, int capacity, std::chrono::milliseconds max_age)
+  : pool(pool), policy(policy), queue_capacity(policy == queue_policy::latest ? 1 : capacity), max_age(max_age) {}
+
+bool frame_queue::push(image_data frame) {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  if (policy == queue_policy::fifo) {
+    not_full.wait(lock, [&] { return is_shutdown || static_cast<int>(frames.size()) < queue_capacity; });
+  } else if (static_cast<int>(frames.size()) >= queue_capacity) {
+/*the oldest waiting frame is the least useful one*/
+    pool.release(frames.front().slot);
+    frames.pop_front();
+    frames_dropped++;
+  }
+
+  if (is_shutdown) {
+    lock.unlock();
+    pool.release(frame.slot);
+    return false;
+  }
+
+  frames.push_back(std::move(frame));
+  lock.unlock();
+  not_empty.notify_one();
+  return true;
+}
+
+bool frame_queue::pop(image_data& frame, std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!is_shutdown) {
+    if (policy == queue_policy::max_age) { dropExpired(std::chrono::steady_clock::now()); }
+    if (!frames.empty()) { break; }
+    if (not_empty.wait_until(lock, deadline) == std::cv_status::timeout) {
+      if (policy == queue_policy::max_age) { dropExpired(std::chrono::steady_clock::now()); }
+      break;
+    }
+  }
+  bool const popped = takeFront(frame);
+  lock.unlock();
+  if (popped) { not_full.notify_one(); }
+  return popped;
+}
+
+int frame_queue::size() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return static_cast<int>(frames.size());
+}
+
+bool frame_queue::try_pop(image_data& frame) {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (policy == queue_policy::max_age) { dropExpired(std::chrono::steady_clock::now()); }
+  bool const popped = takeFront(frame);
+  lock.unlock();
+  if (popped) { not_full.notify_one(); }
+  return popped;
+}
+
+void frame_queue::shutdown() {
+  std::unique_lock<std::mutex> lock(mutex);
+  is_shutdown = true;
+  for (auto& i : frames) { pool.release(i.slot); }
+  frames.clear();
+  lock.unlock();
+  not_empty.notify_all();
+  not_full.notify_all();
+}
+
+void frame_queue::dropExpired(std::chrono::steady_clock::time_point now) {
+  while (!frames.empty() && now - frames.front().timestamp > max_age) {
+    pool.release(frames.front().slot);
+    frames.pop_front();
+    frames_dropped++;
+  }
+}
+
+bool frame_queue::takeFront(image_data& frame) {
+  if (frames.empty()) { return false; }
+  frame = std::move(frames.front());
+  frames.pop_front();
+  return true;
+}
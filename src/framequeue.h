@@ -0,0 +1,65 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include "framepool.h"
+
+struct image_data {
+  int slot = -1; //frame pool slot, or -1 if the frame owns its own memory
+  cv::Mat frame;
+  unsigned long frame_id = 0;
+  std::chrono::steady_clock::time_point timestamp; //when the frame was captured
+};
+
+enum class queue_policy {
+  latest, //single-slot mailbox, a new frame replaces the waiting one
+  fifo,   //bounded queue, the producer waits while it is full
+  max_age //bounded queue, frames older than the age limit are dropped
+};
+
+bool parseQueuePolicy(std::string const& spec, queue_policy& policy, std::chrono::milliseconds& max_age);
+
+/*hands captured frames from the capture thread to the processing thread*/
+class frame_queue {
+public:
+  frame_queue(frame_pool& pool, queue_policy policy, int capacity = 10,
+              std::chrono::milliseconds max_age = std::chrono::milliseconds(100));
+
+  frame_queue(const frame_queue&) = delete;
+  frame_queue& operator=(const frame_queue&) = delete;
+
+/*returns false once the queue has been shut down, the frame is then released*/
+  bool push(image_data frame);
+/*waits until a frame is available, the deadline passes, or the queue is shut down*/
+  bool pop(image_data& frame, std::chrono::steady_clock::time_point deadline);
+  bool try_pop(image_data& frame);
+  void shutdown();
+
+/*number of frames the queue can hold for the given policy*/
+  int capacity() const { return queue_capacity; }
+/*number of frames waiting right now*/
+  int size();
+  unsigned long dropped() const { return frames_dropped.load(); }
+
+private:
+  void dropExpired(std::chrono::steady_clock::time_point now);
+  bool takeFront(image_data& frame);
+
+  frame_pool& pool;
+  queue_policy const policy;
+  int const queue_capacity;
+  std::chrono::milliseconds const max_age;
+
+  std::mutex mutex;
+  std::condition_variable not_empty, not_full;
+  std::deque<image_data> frames;
+  bool is_shutdown = false;
+  std::atomic<unsigned long> frames_dropped{0};
+};
+
+#endif //FRAMEQUEUE_H
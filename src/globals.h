@@ -12,37 +12,86 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <cerrno>
+#include <type_traits>
 #include <memory>
 #include <vector>
 #include <iostream>
 #include <chrono>
 #include <iomanip>
 #include <fstream>
+#include <sstream>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <functional>
+#include <algorithm>
+#include <numeric>
 #include <future>
 #include <queue>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <tbb/concurrent_queue.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 
 #ifndef DISABLE_OSVR
 #include <osvr/ClientKit/ClientKit.h>
 #include <osvr/ClientKit/Display.h>
+#include <osvr/ClientKit/InterfaceStateC.h>
 #endif
 
-struct kb_control_input {
-  int key, code, action, modifiers;
-};
+#include "ring.h"
+#include "seqlock.h"
 
-struct ms_control_input {
-  int button, action, mods;
-  double xpos, ypos;
+/*a keyboard or mouse event as delivered by a GLFW callback*/
+struct control_event {
+  enum event_type {KEY, MOUSE_BUTTON, CURSOR} type;
+  int code; //key or mouse button
+  int scancode;
+  int action;
+  int modifiers;
+  double xpos, ypos; //cursor position
+  std::chrono::steady_clock::time_point timestamp; //when the event reached the program
 };
 
+/*a copy of the joystick state, so nothing points into GLFW's buffers*/
 struct js_control_input {
-   const unsigned char* buttons;
-   const float* axes;
+  int button_count = 0;
+  int axis_count = 0;
+  unsigned char buttons[32] = {};
+  float axes[16] = {};
+  std::chrono::steady_clock::time_point timestamp;
+};
+
+/*one tracked hand, positions in millimetres like the Leap Motion SDK reports them*/
+struct hand_sample {
+  std::int32_t id; //stays the same while the hand is tracked
+  std::int32_t right;
+  float palm[3];
+  float palm_normal[3];
+  float tips[5][3]; //thumb to pinky
+  float pinch, grab;
+};
+
+/*the hands seen in one Leap Motion frame; fixed size so it can be published and recorded as is*/
+struct hand_frame {
+  std::int64_t frame_id;
+  std::int64_t timestamp_us; //device clock
+  std::int32_t hand_count;
+  std::int32_t reserved;
+  hand_sample hands[2];
 };
 
 struct Globals {
@@ -55,12 +104,21 @@ struct Globals {
     bool edge_filter_ext = false;
     bool display_time = false;
     bool display_name = false;
-    bool joystick_connected = false;
+    std::atomic<bool> joystick_connected{false};
+    bool joystick_polled = false; //sampled on its own thread instead of by handleEvents()
     bool fullscreen = true;
+    bool dump_trace = false;
     bool save_output_videofile = false;
   } flags;
 
-  tbb::concurrent_bounded_queue<kb_control_input> kb_control_queue;
-  tbb::concurrent_bounded_queue<ms_control_input> ms_control_queue;
-  tbb::concurrent_bounded_queue<js_control_input> js_control_queue;
+  int display_stream = 0;
+
+  struct {
+    double seek = 0; //seconds to move the video files by, taken by the main loop
+    double speed_factor = 1; //to scale their playback speed by, taken by the main loop
+  } playback;
+
+  spsc_ring<control_event, 256> input_events; //filled by the GLFW callbacks, drained every frame
+  seqlock<js_control_input> joystick; //latest joystick state, written by one thread and read by any
+  seqlock<hand_frame> hands; //latest smoothed hands
 };
@@ -0,0 +1,167 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "hands.h"
+
+extern Globals global;
+
+static const char HAND_FILE_MAGIC[4] = {'C', 'H', 'N', 'D'};
+static const std::uint32_t HAND_FILE_VERSION = 1;
+
+struct hand_file_header {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t frame_size; //guards against reading a file written with another layout
+};
+
+static float smoothingFactor(float dt, float cutoff) {
+  float const tau = 1.0f / (2.0f * static_cast<float>(M_PI) * cutoff);
+  return 1.0f / (1.0f + tau / dt);
+}
+
+float one_euro_filter::filter(float x, float dt) {
+  if (!initialized || dt <= 0) {
+    initialized = true;
+    previous = x;
+    previous_derivative = 0;
+    return x;
+  }
+  float const derivative = (x - previous) / dt;
+  float const a_d = smoothingFactor(dt, derivative_cutoff);
+  previous_derivative = a_d * derivative + (1 - a_d) * previous_derivative;
+
+  float const cutoff = min_cutoff + beta * std::fabs(previous_derivative);
+  float const a = smoothingFactor(dt, cutoff);
+  previous = a * x + (1 - a) * previous;
+  return previous;
+}
+
+void hand_filter::onHands(hand_frame const& frame) {
+  float const dt = (last_timestamp > 0) ? (frame.timestamp_us - last_timestamp) / 1e6f : 0.0f;
+  last_timestamp = frame.timestamp_us;
+
+  hand_frame smoothed = frame;
+  int const hand_count = std::min(std::max(frame.hand_count, 0), 2);
+  auto inFrame = [&](std::int32_t id) {
+    for (int h = 0; h < hand_count; h++) { if (frame.hands[h].id == id) { return true; } }
+    return false;
+  };
+
+  bool used[2] = {false, false};
+  for (int h = 0; h < hand_count; h++) {
+    hand_sample& hand = smoothed.hands[h];
+
+/*keep following the track of the same hand, or take over one whose hand is gone and start it afresh*/
+    int t = -1;
+    for (int i = 0; i < 2 && t < 0; i++) { if (!used[i] && tracks[i].id == hand.id) { t = i; } }
+    if (t < 0) {
+      for (int i = 0; i < 2 && t < 0; i++) { if (!used[i] && !inFrame(tracks[i].id)) { t = i; } }
+/*two hands sharing an id leave no track that is both unused and gone, so take any unused one*/
+      for (int i = 0; i < 2 && t < 0; i++) { if (!used[i]) { t = i; } }
+      tracks[t].id = hand.id;
+      for (auto& value : tracks[t].values) { value.reset(); }
+    }
+    used[t] = true;
+
+    float* const values[VALUES / 3] = {hand.palm, hand.palm_normal, hand.tips[0], hand.tips[1], hand.tips[2], hand.tips[3], hand.tips[4]};
+    for (int v = 0; v < VALUES; v++) {
+      float& value = values[v / 3][v % 3];
+      value = tracks[t].values[v].filter(value, dt);
+    }
+  }
+  for (int t = 0; t < 2; t++) {
+    if (!used[t]) { tracks[t].id = -1; }
+  }
+
+  global.hands.store(smoothed);
+}
+
+hand_recorder::hand_recorder(std::string const& path, hand_listener& next)
+  : out(path, std::ios::binary), next(next) {
+  hand_file_header header;
+  std::memcpy(header.magic, HAND_FILE_MAGIC, sizeof(header.magic));
+  header.version = HAND_FILE_VERSION;
+  header.frame_size = sizeof(hand_frame);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void hand_recorder::onHands(hand_frame const& frame) {
+  out.write(reinterpret_cast<const char*>(&frame), sizeof(frame));
+  next.onHands(frame);
+}
+
+bool parseHandReplaySpec(std::string const& spec, std::string& path, double& speed) {
+  path = spec;
+  speed = 1.0;
+  size_t const at = path.rfind('@');
+  if (at != std::string::npos) {
+    char* end = NULL;
+    double const value = std::strtod(path.c_str() + at + 1, &end);
+    if (at + 1 < path.size() && *end == '\0') {
+      if (value < 0) { return false; }
+      speed = value;
+      path.resize(at);
+    }
+  }
+  return !path.empty();
+}
+
+hand_replay::hand_replay(std::string const& path, hand_listener& listener, double speed, bool loop)
+  : path(path), listener(listener), speed(speed), loop(loop) {}
+
+hand_replay::~hand_replay() {
+  stop();
+}
+
+bool hand_replay::start() {
+  std::ifstream in(path, std::ios::binary);
+  hand_file_header header;
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) { return false; }
+  if (std::memcmp(header.magic, HAND_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != HAND_FILE_VERSION || header.frame_size != sizeof(hand_frame)) { return false; }
+
+  hand_frame frame;
+  frames.clear();
+  while (in.read(reinterpret_cast<char*>(&frame), sizeof(frame))) {
+/*the file may come from anywhere: keep the hand count in range and drop a second hand with the same id*/
+    frame.hand_count = std::min(std::max(frame.hand_count, 0), 2);
+    if (frame.hand_count == 2 && frame.hands[0].id == frame.hands[1].id) { frame.hand_count = 1; }
+    frames.push_back(frame);
+  }
+  if (frames.empty()) { return false; }
+
+  running = true;
+  thread = std::thread(&hand_replay::run, this);
+  return true;
+}
+
+void hand_replay::stop() {
+  running = false;
+  if (thread.joinable()) { thread.join(); }
+}
+
+void hand_replay::run() {
+/*each pass shifts the recorded timestamps so the filter sees time moving forward across loops*/
+  std::int64_t offset_us = 0;
+  do {
+    auto const pass_start = std::chrono::steady_clock::now();
+    std::int64_t const first_us = frames.front().timestamp_us;
+    for (size_t i = 0; i < frames.size() && running; i++) {
+      hand_frame frame = frames[i];
+      if (speed > 0) {
+        auto const due = pass_start + std::chrono::microseconds(static_cast<std::int64_t>((frame.timestamp_us - first_us) / speed));
+        std::this_thread::sleep_until(due);
+      }
+      frame.timestamp_us += offset_us;
+      listener.onHands(frame);
+      frames_played++;
+    }
+/*leave one typical frame interval between the last frame of a pass and the first of the next*/
+    std::int64_t const span_us = frames.back().timestamp_us - first_us;
+    offset_us += span_us + (frames.size() > 1 ? span_us / static_cast<std::int64_t>(frames.size() - 1) : 10000);
+  } while (loop && running);
+}
@@ -0,0 +1,100 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef HANDS_H
+#define HANDS_H
+
+/*hand tracking independent of the Leap Motion SDK, so it can be filtered, recorded and replayed
+  without the device; the frames themselves (hand_frame) are defined in globals.h*/
+
+/*receives every hand frame, from the device or from a replay*/
+class hand_listener {
+public:
+  virtual ~hand_listener() {}
+  virtual void onHands(hand_frame const& frame) = 0;
+};
+
+/*the One-Euro filter: smooths hard while the input moves slowly and follows quickly when it moves fast*/
+class one_euro_filter {
+public:
+  one_euro_filter(float min_cutoff = 1.0f, float beta = 0.01f, float derivative_cutoff = 1.0f)
+    : min_cutoff(min_cutoff), beta(beta), derivative_cutoff(derivative_cutoff) {}
+
+  float filter(float x, float dt);
+  void reset() { initialized = false; }
+
+private:
+  float const min_cutoff, beta, derivative_cutoff;
+  float previous = 0, previous_derivative = 0;
+  bool initialized = false;
+};
+
+/*smooths each frame incrementally, the work per frame does not depend on any history length,
+  and publishes the result to global.hands for the render thread*/
+class hand_filter : public hand_listener {
+public:
+  void onHands(hand_frame const& frame) override;
+
+private:
+  static const int VALUES = 3 + 3 + 5*3; //palm, palm normal and fingertips
+
+  struct hand_track {
+    std::int32_t id = -1;
+    one_euro_filter values[VALUES];
+  };
+
+  hand_track tracks[2];
+  std::int64_t last_timestamp = 0;
+};
+
+/*writes every frame to a file and passes it on*/
+class hand_recorder : public hand_listener {
+public:
+  hand_recorder(std::string const& path, hand_listener& next);
+  bool isOpen() const { return static_cast<bool>(out); }
+  void onHands(hand_frame const& frame) override;
+
+private:
+  std::ofstream out;
+  hand_listener& next;
+};
+
+/*parses "FILE[@SPEED]" for hand_replay; speed 1 (default) keeps the recorded timing, 0 plays the
+  frames once, as fast as the listener takes them*/
+bool parseHandReplaySpec(std::string const& spec, std::string& path, double& speed);
+
+/*a stand-in for the device: plays a recorded file to a listener on its own thread,
+  with the recorded timing or, at speed 0, as fast as the listener takes the frames*/
+class hand_replay {
+public:
+  hand_replay(std::string const& path, hand_listener& listener, double speed = 1.0, bool loop = true);
+  ~hand_replay();
+
+  hand_replay(const hand_replay&) = delete;
+  hand_replay& operator=(const hand_replay&) = delete;
+
+/*loads the file and starts playing, returns false if it cannot be read*/
+  bool start();
+  void stop();
+
+  size_t frameCount() const { return frames.size(); }
+  unsigned long played() const { return frames_played.load(); }
+
+private:
+  void run();
+
+  std::string const path;
+  hand_listener& listener;
+  double const speed;
+  bool const loop;
+  std::vector<hand_frame> frames;
+
+  std::atomic<bool> running{false};
+  std::atomic<unsigned long> frames_played{0};
+  std::thread thread;
+};
+
+#endif //HANDS_H
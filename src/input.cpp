@@ -10,22 +10,30 @@
 extern Globals global;
 
 void handleKey(GLFWwindow* window, int key, int code, int action, int modifiers) {
-  global.kb_control_queue.try_emplace(kb_control_input{key, code, action, modifiers});
+  global.input_events.push(control_event{control_event::KEY, key, code, action, modifiers, 0, 0, std::chrono::steady_clock::now()});
 }
 
 void handleMouseButton(GLFWwindow* window, int button, int action, int mods) {
   double xpos, ypos;
   glfwGetCursorPos(window, &xpos, &ypos);
-  global.ms_control_queue.try_emplace(ms_control_input{button, action, mods, xpos, ypos});
+  global.input_events.push(control_event{control_event::MOUSE_BUTTON, button, 0, action, mods, xpos, ypos, std::chrono::steady_clock::now()});
+}
+
+void handleCursor(GLFWwindow* window, double xpos, double ypos) {
+  global.input_events.push(control_event{control_event::CURSOR, 0, 0, 0, 0, xpos, ypos, std::chrono::steady_clock::now()});
 }
 
 void handleJoystick(int joystick) {
+  js_control_input state;
+
 /*Buttons only report a state of pressed/unpressed*/
   int buttons_count;
   const unsigned char* buttons = glfwGetJoystickButtons(joystick, &buttons_count);
+  state.button_count = std::min(std::max(buttons_count, 0), static_cast<int>(sizeof(state.buttons)));
+  if (buttons) { std::memcpy(state.buttons, buttons, state.button_count); }
 /*
-  for (int i = 0; i < buttons_count; i++) {
-    std::printf("%d\n", buttons[i]);
+  for (int i = 0; i < state.button_count; i++) {
+    std::printf("%d\n", state.buttons[i]);
   }
   std::cout << std::endl << std::endl;
 */
@@ -33,67 +41,136 @@ void handleJoystick(int joystick) {
 /*Axes can be used to check how hard a button is being pressed, and also which way the thumbsticks are pointing*/
   int axes_count;
   const float* axes = glfwGetJoystickAxes(joystick, &axes_count);
+  state.axis_count = std::min(std::max(axes_count, 0), static_cast<int>(sizeof(state.axes) / sizeof(state.axes[0])));
+  if (axes) { std::memcpy(state.axes, axes, state.axis_count * sizeof(float)); }
 /*
-  for (int i = 0; i < axes_count; i++) {
-    std::printf("%f\n", axes[i]);
+  for (int i = 0; i < state.axis_count; i++) {
+    std::printf("%f\n", state.axes[i]);
   }
   std::cout << std::endl << std::endl;
 */
 
-  global.js_control_queue.try_emplace(js_control_input{buttons, axes});
+  state.timestamp = std::chrono::steady_clock::now();
+  global.joystick.store(state);
+}
+
+/*merges events that add nothing to the one before: key repeats of the same key, and cursor moves;
+  the merged event keeps the older timestamp so that latency is measured from the first of them*/
+static bool coalesce(std::vector<control_event>& batch, control_event const& event) {
+  if (batch.empty()) { return false; }
+  control_event& last = batch.back();
+  if (event.type == control_event::CURSOR && last.type == control_event::CURSOR) {
+    last.xpos = event.xpos;
+    last.ypos = event.ypos;
+    return true;
+  }
+  if (event.type == control_event::KEY && event.action == GLFW_REPEAT &&
+      last.type == control_event::KEY && last.action == GLFW_REPEAT && last.code == event.code) {
+    return true;
+  }
+  return false;
+}
+
+static void handleKeyEvent(control_event const& kb_event) {
+  if (kb_event.action != GLFW_PRESS) { return; }
+//  std::printf("%d \n", kb_event.code);
+  switch (kb_event.code) {
+    case GLFW_KEY_ESCAPE:
+      global.flags.is_running = false;
+      break;
+    case GLFW_KEY_C:
+      global.display_stream++;
+      break;
+    case GLFW_KEY_D:
+      global.flags.dump_trace = true;
+      break;
+    case GLFW_KEY_E:
+      if (kb_event.modifiers == GLFW_MOD_SHIFT) {
+        if (global.flags.edge_filter == false) { global.flags.edge_filter = true; }
+        global.flags.edge_filter_ext = !(global.flags.edge_filter_ext);
+        break;
+      }
+      global.flags.edge_filter = !(global.flags.edge_filter);
+      break;
+    case GLFW_KEY_F:
+      global.flags.flip_image = !(global.flags.flip_image);
+      break;
+    case GLFW_KEY_I:
+      global.flags.show_items = !(global.flags.show_items);
+      break;
+    case GLFW_KEY_N:
+      global.flags.display_name = !(global.flags.display_name);
+      break;
+    case GLFW_KEY_T:
+      global.flags.display_time = !(global.flags.display_time);
+      break;
+    case GLFW_KEY_LEFT:
+      global.playback.seek -= (kb_event.modifiers == GLFW_MOD_SHIFT) ? 60 : 10;
+      break;
+    case GLFW_KEY_RIGHT:
+      global.playback.seek += (kb_event.modifiers == GLFW_MOD_SHIFT) ? 60 : 10;
+      break;
+    case GLFW_KEY_LEFT_BRACKET:
+      global.playback.speed_factor /= 2;
+      break;
+    case GLFW_KEY_RIGHT_BRACKET:
+      global.playback.speed_factor *= 2;
+      break;
+    default:
+      break;
+  }
 }
 
-void handleEvents() {
+static js_control_input joystick_state;
+static unsigned long joystick_version = 0;
 
-  kb_control_input kb_event;
-  global.kb_control_queue.try_pop(kb_event);
+js_control_input const& joystickState() {
+  return joystick_state;
+}
 
-  if (kb_event.action == GLFW_PRESS) {
-//    std::printf("%d \n", kb_event.key);
-    switch (kb_event.key) {
-      case GLFW_KEY_ESCAPE:
-        global.flags.is_running = false;
+std::chrono::steady_clock::time_point handleEvents(std::vector<control_event>* handled) {
+
+/*take everything that arrived since the last frame, so bursts of input do not lag behind*/
+  static std::vector<control_event> batch;
+  batch.clear();
+  control_event event;
+  while (global.input_events.pop(event)) {
+    if (!coalesce(batch, event)) { batch.push_back(event); }
+  }
+
+  std::chrono::steady_clock::time_point oldest;
+  for (auto const& e : batch) {
+    if (oldest == std::chrono::steady_clock::time_point() || e.timestamp < oldest) { oldest = e.timestamp; }
+    switch (e.type) {
+      case control_event::KEY:
+        handleKeyEvent(e);
         break;
-      case GLFW_KEY_E:
-        if (kb_event.modifiers == GLFW_MOD_SHIFT) {
-          if (global.flags.edge_filter == false) { global.flags.edge_filter = true; }
-          global.flags.edge_filter_ext = !(global.flags.edge_filter_ext);
-          break;
+      case control_event::MOUSE_BUTTON:
+        if (e.action == GLFW_PRESS) {
+//        std::cout << e.xpos << ", " << e.ypos << std::endl;
         }
-        global.flags.edge_filter = !(global.flags.edge_filter);
-        break;
-      case GLFW_KEY_F:
-        global.flags.flip_image = !(global.flags.flip_image);
-        break;
-      case GLFW_KEY_I:
-        global.flags.show_items = !(global.flags.show_items);
-        break;
-      case GLFW_KEY_N:
-        global.flags.display_name = !(global.flags.display_name);
         break;
-      case GLFW_KEY_T:
-        global.flags.display_time = !(global.flags.display_time);
-        break;
-      default:
+      case control_event::CURSOR:
         break;
     }
   }
+  if (handled) { *handled = batch; }
 
-  ms_control_input ms_event;
-  global.ms_control_queue.try_pop(ms_event);
-
-  if (ms_event.action == GLFW_PRESS) {
-//    std::cout << ms_event.xpos << ", " << ms_event.ypos << std::endl;
+/*without a polling thread the joystick is sampled here, once per frame*/
+  if (global.flags.joystick_connected && !global.flags.joystick_polled) { handleJoystick(GLFW_JOYSTICK_1); }
+/*the snapshot is only copied when a new one has been published since the last frame*/
+  unsigned long const version = global.joystick.version();
+  if (version != joystick_version) {
+    joystick_version = version;
+    joystick_state = global.joystick.load();
   }
-
-  if (global.flags.joystick_connected) { handleJoystick(GLFW_JOYSTICK_1); }
-
-  js_control_input js_event;
-  global.js_control_queue.try_pop(js_event);
 /*
+  js_control_input const& js_event = joystick_state;
   if (js_event.buttons[JOYSTICK_CROSS]) { std::printf("Cross\n"); }
   if (js_event.buttons[JOYSTICK_CIRCLE]) { std::printf("Circle\n"); }
   if (js_event.buttons[JOYSTICK_TRIANGLE]) { std::printf("Triangle\n"); }
   if (js_event.buttons[JOYSTICK_SQUARE]) { std::printf("Square\n"); }
 */
+
+  return oldest;
 }
@@ -28,7 +28,12 @@
 
 void handleKey(GLFWwindow* window, int key, int code, int action, int modifiers);
 void handleMouseButton(GLFWwindow* window, int button, int action, int mods);
+void handleCursor(GLFWwindow* window, double xpos, double ypos);
 void handleJoystick(int joystick);
-void handleEvents();
+/*applies all input queued since the last call, returns the time of the oldest event or a default
+  time point if there was none; the events applied are copied to HANDLED if it is given*/
+std::chrono::steady_clock::time_point handleEvents(std::vector<control_event>* handled = NULL);
+/*the joystick state as of the last handleEvents() call*/
+js_control_input const& joystickState();
 
 #endif //INPUT_H
@@ -0,0 +1,119 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "joystick.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/joystick.h>
+#endif
+
+extern Globals global;
+
+/*how long to wait before trying to reopen an unplugged device*/
+static const std::chrono::seconds REOPEN_DELAY(1);
+
+bool parseJoystickRate(std::string const& spec, int& rate) {
+  char* end;
+  long const value = std::strtol(spec.c_str(), &end, 10);
+  if (end == spec.c_str() || *end != '\0' || value < 0 || value > 10000) { return false; }
+  rate = static_cast<int>(value);
+  return true;
+}
+
+std::string defaultJoystickDevice() {
+  return "/dev/input/js0";
+}
+
+joystick_poller::joystick_poller(std::string const& device, int rate)
+  : device(device),
+    period(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / std::max(rate, 1)))) {}
+
+joystick_poller::~joystick_poller() {
+  stop();
+}
+
+bool joystick_poller::open() {
+#ifdef __linux__
+  fd = ::open(device.c_str(), O_RDONLY | O_NONBLOCK);
+  return fd >= 0;
+#else
+  return false;
+#endif
+}
+
+bool joystick_poller::start() {
+  if (!open()) { return false; }
+  running = true;
+  thread = std::thread(&joystick_poller::run, this);
+  return true;
+}
+
+void joystick_poller::stop() {
+  running = false;
+  if (thread.joinable()) { thread.join(); }
+#ifdef __linux__
+  if (fd >= 0) { ::close(fd); }
+#endif
+  fd = -1;
+}
+
+bool joystick_poller::drain(js_control_input& state) {
+  bool changed = false;
+#ifdef __linux__
+  struct js_event events[32];
+  while (true) {
+    ssize_t const bytes = ::read(fd, events, sizeof(events));
+    if (bytes <= 0) {
+/*EAGAIN means there is nothing more to read, anything else means the device is gone*/
+      if (bytes < 0 && errno != EAGAIN) { ::close(fd); fd = -1; }
+      break;
+    }
+    for (size_t i = 0; i < bytes / sizeof(struct js_event); i++) {
+      struct js_event const& event = events[i];
+      int const type = event.type & ~JS_EVENT_INIT;
+      if (type == JS_EVENT_BUTTON && event.number < sizeof(state.buttons)) {
+        state.buttons[event.number] = event.value ? GLFW_PRESS : GLFW_RELEASE;
+        state.button_count = std::max(state.button_count, event.number + 1);
+        changed = true;
+      } else if (type == JS_EVENT_AXIS && event.number < sizeof(state.axes) / sizeof(state.axes[0])) {
+        state.axes[event.number] = event.value / 32767.0f; //the same range GLFW reports
+        state.axis_count = std::max(state.axis_count, event.number + 1);
+        changed = true;
+      }
+    }
+  }
+#endif
+  return changed;
+}
+
+void joystick_poller::run() {
+  js_control_input state;
+  auto next_sample = std::chrono::steady_clock::now();
+  while (running) {
+    if (fd < 0) {
+      global.flags.joystick_connected = false;
+      std::this_thread::sleep_for(REOPEN_DELAY);
+      if (!open()) { continue; }
+      state = js_control_input();
+      global.flags.joystick_connected = true;
+      next_sample = std::chrono::steady_clock::now();
+    }
+
+/*publish only when something changed, so the version tells the reader whether to look*/
+    if (drain(state)) {
+      state.timestamp = std::chrono::steady_clock::now();
+      global.joystick.store(state);
+    }
+    sample_count++;
+
+    next_sample += period;
+    auto const now = std::chrono::steady_clock::now();
+    if (next_sample < now) { next_sample = now; } //do not try to catch up after a stall
+    std::this_thread::sleep_until(next_sample);
+  }
+}
@@ -0,0 +1,46 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef JOYSTICK_H
+#define JOYSTICK_H
+
+/*parses the joystick sampling rate in samples per second, up to 10000; 0 samples once per frame*/
+bool parseJoystickRate(std::string const& spec, int& rate);
+/*the joystick device the sampling thread reads by default: the first one, like GLFW_JOYSTICK_1*/
+std::string defaultJoystickDevice();
+
+/*samples a joystick on its own thread at a fixed rate and publishes the state to global.joystick,
+  so trigger and thumbstick reads do not depend on the video frame rate;
+  GLFW only allows joystick polling from the main thread, so the device is read directly*/
+class joystick_poller {
+public:
+  joystick_poller(std::string const& device, int rate);
+  ~joystick_poller();
+
+  joystick_poller(const joystick_poller&) = delete;
+  joystick_poller& operator=(const joystick_poller&) = delete;
+
+/*returns false if the device cannot be opened, or if direct access is not supported on this platform*/
+  bool start();
+  void stop();
+
+  unsigned long samples() const { return sample_count.load(); }
+
+private:
+  void run();
+  bool open();
+  bool drain(js_control_input& state); //reads all pending device events, true if the state changed
+
+  std::string const device;
+  std::chrono::steady_clock::duration const period;
+  int fd = -1;
+
+  std::atomic<bool> running{false};
+  std::atomic<unsigned long> sample_count{0};
+  std::thread thread;
+};
+
+#endif //JOYSTICK_H
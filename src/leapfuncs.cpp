@@ -9,6 +9,12 @@
 
 extern Globals global;
 
+static void copyVector(Leap::Vector const& from, float* to) {
+  to[0] = from.x;
+  to[1] = from.y;
+  to[2] = from.z;
+}
+
 void leap_event_listener::onConnect(const Leap::Controller& controller) {
   std::cout << "LeapMotion connected" << std::endl;
 }
@@ -18,41 +24,33 @@ void leap_event_listener::onDisconnect(const Leap::Controller& controller) {
 }
 
 void leap_event_listener::onFrame(const Leap::Controller& controller) {
-  Leap::Frame frame = controller.frame();
-  Leap::HandList hands = frame.hands();
-  Leap::PointableList pointables = frame.pointables();
-  Leap::FingerList fingers = frame.fingers();
-  Leap::ToolList tools = frame.tools();
-  Leap::GestureList gestures = frame.gestures();
-
-  int count = 0;
-  Leap::Vector average = Leap::Vector();
-  Leap::Finger finger_to_average = frame.fingers()[0];
-  for (int i = 0; i < 10; i++) {
-    Leap::Finger finger_from_frame = controller.frame(i).finger(finger_to_average.id());
-    if (finger_from_frame.isValid()) {
-      average += finger_from_frame.tipPosition();
-      count++;
+  Leap::Frame const frame = controller.frame();
+  Leap::HandList const hand_list = frame.hands();
+
+  hand_frame out = hand_frame();
+  out.frame_id = frame.id();
+  out.timestamp_us = frame.timestamp();
+  for (Leap::HandList::const_iterator i = hand_list.begin(); i != hand_list.end() && out.hand_count < 2; i++) {
+    Leap::Hand const& hand = *i;
+    hand_sample& sample = out.hands[out.hand_count++];
+    sample.id = hand.id();
+    sample.right = hand.isRight();
+    copyVector(hand.palmPosition(), sample.palm);
+    copyVector(hand.palmNormal(), sample.palm_normal);
+    sample.pinch = hand.pinchStrength();
+    sample.grab = hand.grabStrength();
+    Leap::FingerList const fingers = hand.fingers();
+    for (Leap::FingerList::const_iterator f = fingers.begin(); f != fingers.end(); f++) {
+      int const type = (*f).type();
+      if (type >= 0 && type < 5) { copyVector((*f).tipPosition(), sample.tips[type]); }
     }
   }
 
-/*for (Leap::GestureList::const_iterator i = gestures.begin(); i != gestures.end(); i ++) {
+/*for (Leap::GestureList::const_iterator i = frame.gestures().begin(); i != frame.gestures().end(); i ++) {
     std::cout << (*i).type() << std::endl;
     if ((*i).type() == Leap::Gesture::TYPE_SWIPE) { global.flags.show_items = true; }
   }
 */
 
-  average /= count;
-/*std::cout << "average position: " << average << std::endl;
-  std::cout << "hand count: " << hands.count() << std::endl;
-
-  for (Leap::HandList::const_iterator i = hands.begin(); i != hands.end(); i++) {
-    std::cout << "pinch strength: " << (*i).pinchStrength() << std::endl;
-    if ((*i).pinchStrength() == 1) { global.flags.is_running = false; }
-    std::cout << "palm direction: " << (*i).palmNormal() << std::endl;
-  }
-  std::cout << "--------------------" << std::endl;
-*/
+  hands.onHands(out);
 }
-
-
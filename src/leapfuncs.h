@@ -8,12 +8,20 @@
 #define LEAPFUNCS_H
 
 #include "Leap.h"
+#include "hands.h"
 
+/*converts each Leap Motion frame into a hand_frame and hands it to a hand_listener;
+  only the current frame is read, so the SDK callback does a fixed amount of work*/
 class leap_event_listener : public Leap::Listener {
 public:
+  explicit leap_event_listener(hand_listener& hands) : hands(hands) {}
+
   virtual void onConnect(const Leap::Controller&);
   virtual void onDisconnect(const Leap::Controller&);
   virtual void onFrame(const Leap::Controller&);
+
+private:
+  hand_listener& hands;
 };
 
 #endif //LEAPFUNCS_H
@@ -0,0 +1,234 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "playback.h"
+#include "trace.h"
+
+/*a frame this late restarts the presentation clock, so playback slips instead of rushing to catch up*/
+static const std::chrono::milliseconds MAX_LATENESS(250);
+/*a frame this far ahead in the file's time restarts it too: a gap in the timestamps is skipped
+  instead of leaving the capture thread asleep for its length*/
+static const std::chrono::seconds MAX_EARLINESS(2);
+static const double MIN_SPEED = 1.0 / 16, MAX_SPEED = 16;
+
+bool isVideoFile(std::string const& path) {
+  size_t const dot = path.find_last_of(".");
+  if (dot == std::string::npos) { return false; }
+  std::string const file_ext = path.substr(dot + 1);
+  return file_ext == "avi" || file_ext == "mp4" || file_ext == "mpjg" || file_ext == "mov";
+}
+
+/*strips "<MARK>NUMBER" from the end of SPEC if it is there*/
+static bool takeSuffix(std::string& spec, char mark, double& value) {
+  size_t const at = spec.rfind(mark);
+  if (at == std::string::npos || at + 1 >= spec.size()) { return false; }
+  char* end = NULL;
+  double const number = std::strtod(spec.c_str() + at + 1, &end);
+  if (*end != '\0' || number < 0) { return false; }
+  value = number;
+  spec.resize(at);
+  return true;
+}
+
+bool parsePlaybackSpec(std::string const& spec, std::string& path, playback_options& options) {
+  path = spec;
+  takeSuffix(path, '@', options.speed);
+  takeSuffix(path, '+', options.start);
+  return isVideoFile(path);
+}
+
+file_source::file_source(std::string const& path, playback_options const& options)
+  : path(path), segment_length(static_cast<std::int64_t>(std::max(options.segment_seconds, 0.01) * 1e6)),
+    segments_ahead(std::max(1, options.segments_ahead)), capture(path), speed(options.speed) {
+  if (!capture.isOpened()) { return; }
+  fps = capture.get(cv::CAP_PROP_FPS);
+  if (!(fps > 0)) { fps = 30; }
+  double const frame_count = capture.get(cv::CAP_PROP_FRAME_COUNT);
+  if (frame_count > 1) { duration = (frame_count - 1) / fps; }
+  opened = true;
+
+  if (options.start > 0) { seek(options.start); }
+  decoder = std::thread(&file_source::decode, this);
+}
+
+file_source::~file_source() {
+  shutdown();
+  if (decoder.joinable()) { decoder.join(); }
+}
+
+void file_source::shutdown() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  changed.notify_all();
+}
+
+void file_source::decode() {
+  traceThreadName("decode");
+  segment building;
+  std::int64_t last = -1; //the timestamp of the last frame decoded since the last seek
+  std::int64_t seek_base = 0; //where the last seek went, in microseconds
+  std::int64_t skip_until = 0; //frames before a seek target are decoded but not shown
+
+  std::unique_lock<std::mutex> guard(lock);
+  unsigned long started = generation;
+  while (!stopping) {
+    if (seek_pending) {
+      seek_pending = false;
+      started = generation;
+      double const target = seek_target;
+      guard.unlock();
+      {
+        TRACE_SCOPE("decode seek");
+        if (!capture.set(cv::CAP_PROP_POS_MSEC, target * 1000.0)) {
+          capture.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(std::lround(target * fps)));
+        }
+      }
+      building = segment();
+      last = -1;
+      seek_base = static_cast<std::int64_t>(target * 1e6);
+/*the backend may land a little before the target, frames up to half a frame before it are skipped*/
+      skip_until = static_cast<std::int64_t>((target - 0.5 / fps) * 1e6);
+      guard.lock();
+      continue;
+    }
+/*stay a few segments ahead of the playback, that bounds the memory*/
+    if (decoded_all || ahead.size() >= segments_ahead) {
+      changed.wait(guard);
+      continue;
+    }
+    guard.unlock();
+
+    cv::Mat frame;
+    bool decoded;
+    {
+      TRACE_SCOPE("decode");
+      decoded = capture.read(frame) && !frame.empty();
+    }
+    std::int64_t timestamp = 0;
+    if (decoded) {
+/*containers without timestamps report 0, their frames are spaced by the frame rate; a timestamp
+  that goes backwards, e.g. from reordered or broken packets, is moved just past the one before*/
+      double const msec = capture.get(cv::CAP_PROP_POS_MSEC);
+      if (msec > 0) { timestamp = static_cast<std::int64_t>(msec * 1000.0); }
+      else { timestamp = (last < 0) ? seek_base : last + static_cast<std::int64_t>(1e6 / fps); }
+      if (last >= 0 && timestamp <= last) { timestamp = last + 1; }
+      last = timestamp;
+    }
+
+    guard.lock();
+    if (started != generation) { continue; } //a seek threw this frame away
+    if (decoded && timestamp >= skip_until) {
+      building.frames.push_back(frame);
+      building.timestamps.push_back(timestamp);
+    }
+/*a reader that has run dry, e.g. right after a seek, gets the frames without waiting for a whole segment*/
+    if (!building.frames.empty() &&
+        (!decoded || ahead.empty() || timestamp - building.timestamps.front() >= segment_length)) {
+      ahead.push_back(std::move(building));
+      building = segment();
+      changed.notify_all();
+    }
+    if (!decoded) {
+      decoded_all = true;
+      changed.notify_all();
+    }
+  }
+}
+
+void file_source::read(cv::Mat& frame) {
+  cv::Mat next;
+  std::int64_t timestamp = 0;
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+      if (!ahead.empty()) {
+        segment const& current = ahead.front();
+        if (offset >= current.frames.size()) {
+          ahead.pop_front();
+          offset = 0;
+          changed.notify_all(); //room for the decoder to run ahead again
+          continue;
+        }
+        next = current.frames[offset];
+        timestamp = current.timestamps[offset];
+        offset++;
+        break;
+      }
+      if (decoded_all || stopping) { break; }
+      TRACE_SCOPE("decode wait");
+      changed.wait(guard);
+    }
+  }
+  if (next.empty()) {
+    frame.release(); //the end of the file
+    return;
+  }
+  next.copyTo(frame);
+  present(timestamp);
+}
+
+void file_source::present(std::int64_t timestamp) {
+  std::unique_lock<std::mutex> guard(lock);
+  last_timestamp = timestamp;
+  if (speed <= 0) { return; }
+  auto const now = clock::now();
+  clock::time_point due;
+  if (!rebase) {
+    due = clock_base + std::chrono::microseconds(static_cast<std::int64_t>((timestamp - timestamp_base) / speed));
+    if (now - due > MAX_LATENESS || (due - now) * speed > MAX_EARLINESS) { rebase = true; }
+  }
+  if (rebase) {
+    rebase = false;
+    clock_base = now;
+    timestamp_base = timestamp;
+    return;
+  }
+
+/*the decoder's notifications wake this too, only a seek, a new speed or shutdown end the wait early*/
+  unsigned long const waiting_generation = generation;
+  double const waiting_speed = speed;
+  changed.wait_until(guard, due, [&] { return stopping || generation != waiting_generation || speed != waiting_speed; });
+}
+
+void file_source::seek(double seconds) {
+  std::lock_guard<std::mutex> guard(lock);
+  seekLocked(seconds);
+}
+
+void file_source::seekBy(double seconds) {
+  std::lock_guard<std::mutex> guard(lock);
+  seekLocked(last_timestamp / 1e6 + seconds);
+}
+
+void file_source::seekLocked(double seconds) {
+  seconds = std::max(0.0, seconds);
+  if (duration > 0) { seconds = std::min(seconds, duration); }
+
+  generation++;
+  seek_pending = true;
+  seek_target = seconds;
+  ahead.clear();
+  offset = 0;
+  decoded_all = false;
+  rebase = true;
+  changed.notify_all();
+}
+
+void file_source::scaleSpeed(double factor) {
+  std::lock_guard<std::mutex> guard(lock);
+  if (speed <= 0) { return; } //unthrottled stays unthrottled
+  speed = std::min(std::max(speed * factor, MIN_SPEED), MAX_SPEED);
+  rebase = true;
+  changed.notify_all();
+}
+
+double file_source::position() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return last_timestamp / 1e6;
+}
@@ -0,0 +1,92 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef PLAYBACK_H
+#define PLAYBACK_H
+
+#include "capture.h"
+
+struct playback_options {
+  double speed = 1.0; //0 delivers the frames as fast as they are decoded
+  double start = 0; //seconds into the file
+  double segment_seconds = 1.0; //decoded frames are handed over in segments of about this length
+  int segments_ahead = 3; //how many the decoder may run ahead of the playback, that bounds the memory
+};
+
+/*true for the file types that are played as files rather than opened as cameras*/
+bool isVideoFile(std::string const& path);
+
+/*parses "FILE[+SECONDS][@SPEED]", e.g. "debrief.mp4+90@0.5" plays from 1:30 at half speed;
+  false if FILE is not a video file*/
+bool parsePlaybackSpec(std::string const& spec, std::string& path, playback_options& options);
+
+/*plays a video file at the rate of its container timestamps.
+  A decoder thread reads the file front to back, so every frame is decoded once whatever the
+  keyframe interval, and the FFmpeg backend spreads the decoding over threads of its own. It runs a
+  few segments of about a second ahead of the playback and only seeks when asked to. read() hands
+  out the frames in order and waits until each one is due, instead of decoding as fast as the
+  capture queue drains. Timestamps come from the container, so variable frame rate files keep
+  their timing, and never go backwards between seeks*/
+class file_source : public frame_source {
+public:
+  typedef std::chrono::steady_clock clock;
+
+  file_source(std::string const& path, playback_options const& options);
+  ~file_source();
+
+  file_source(const file_source&) = delete;
+  file_source& operator=(const file_source&) = delete;
+
+  bool isOpened() const { return opened; }
+  void read(cv::Mat& frame) override;
+  void seekBy(double seconds) override;
+  void scaleSpeed(double factor) override;
+  double frameRate() const override { return fps; }
+  void shutdown() override;
+
+/*these can be called from any thread, the next read() continues from the new position*/
+  void seek(double seconds);
+  double position() const; //of the last frame read, in seconds
+
+private:
+  struct segment {
+    std::vector<cv::Mat> frames;
+    std::vector<std::int64_t> timestamps; //microseconds from the start of the file
+  };
+
+  void decode();
+  void seekLocked(double seconds);
+/*waits until the frame with the given timestamp is due, or until a seek, a change of speed or
+  shutdown() cuts the wait short*/
+  void present(std::int64_t timestamp);
+
+  std::string const path;
+  std::int64_t const segment_length; //microseconds
+  size_t const segments_ahead;
+  double fps = 0; //only for containers without timestamps
+  double duration = 0; //seconds, as the container reports it, which may be a little off
+  bool opened = false;
+  cv::VideoCapture capture; //only the decoder thread uses it once that runs
+
+  mutable std::mutex lock;
+  std::condition_variable changed;
+  std::thread decoder;
+  bool stopping = false;
+  unsigned long generation = 0; //bumped by every seek, frames decoded for an older one are thrown away
+  bool seek_pending = false;
+  double seek_target = 0; //seconds
+  std::deque<segment> ahead; //decoded, in order
+  bool decoded_all = false; //the decoder has run into the end of the file
+  size_t offset = 0; //the next frame in the front segment
+
+  double speed;
+  bool rebase = true; //the next frame restarts the presentation clock
+  clock::time_point clock_base;
+  std::int64_t timestamp_base = 0;
+  std::int64_t last_timestamp = 0;
+};
+
+#endif //PLAYBACK_H
@@ -0,0 +1,143 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "pose.h"
+#include "rendering.h"
+#include "trace.h"
+
+static float const DEGREES = static_cast<float>(M_PI) / 180.0f;
+
+/*the difference between two angles, in -pi..pi*/
+static float angleDelta(float to, float from) {
+  float d = std::fmod(to - from + static_cast<float>(M_PI), 2.0f * static_cast<float>(M_PI));
+  if (d < 0) { d += 2.0f * static_cast<float>(M_PI); }
+  return d - static_cast<float>(M_PI);
+}
+
+scripted_pose_source::scripted_pose_source(float amplitude, float frequency)
+  : amplitude(amplitude * DEGREES), frequency(frequency), start(std::chrono::steady_clock::now()) {}
+
+bool scripted_pose_source::sample(head_pose& pose) {
+  pose.timestamp = std::chrono::steady_clock::now();
+  float const t = std::chrono::duration<float>(pose.timestamp - start).count();
+  float const w = 2.0f * static_cast<float>(M_PI) * frequency;
+/*incommensurate rates, so the motion does not repeat quickly*/
+  pose.yaw = amplitude * std::sin(w * t);
+  pose.pitch = 0.5f * amplitude * std::sin(1.3f * w * t);
+  pose.roll = 0.25f * amplitude * std::sin(0.7f * w * t);
+  return true;
+}
+
+bool parseFieldOfView(std::string const& spec, float& degrees) {
+  char* end;
+  float const value = std::strtof(spec.c_str(), &end);
+  if (end == spec.c_str() || *end != '\0' || !(value > 0 && value < 180)) { return false; }
+  degrees = value;
+  return true;
+}
+
+std::unique_ptr<pose_source> openScriptedPoseSource(std::string const& spec) {
+  if (spec.compare(0, 6, "script") != 0) { return nullptr; }
+  float amplitude = 10.0f, frequency = 0.5f;
+  if (spec.size() > 6) {
+    if (spec[6] != ':') { return nullptr; }
+    std::stringstream fields(spec.substr(7));
+    fields >> amplitude;
+    if (!fields || amplitude < 0) { return nullptr; }
+    if (fields.peek() == '@') {
+      fields.get();
+      fields >> frequency;
+      if (!fields || frequency < 0) { return nullptr; }
+    }
+    if (!fields.eof() && fields.peek() != EOF) { return nullptr; }
+  }
+  return std::unique_ptr<pose_source>(new scripted_pose_source(amplitude, frequency));
+}
+
+#ifndef DISABLE_OSVR
+osvr_pose_source::osvr_pose_source(osvr::clientkit::ClientContext& ctx)
+  : ctx(ctx), head(ctx.getInterface("/me/head")) {}
+
+bool osvr_pose_source::sample(head_pose& pose) {
+  ctx.update();
+  pose.timestamp = std::chrono::steady_clock::now();
+
+  OSVR_TimeValue timestamp;
+  OSVR_OrientationState orientation;
+  if (osvrGetOrientationState(head.get(), &timestamp, &orientation) != OSVR_RETURN_SUCCESS) { return false; }
+
+/*OSVR looks down -z with y up, decompose the quaternion as yaw about y, then pitch about x, then roll about z*/
+  double const w = osvrQuatGetW(&orientation), x = osvrQuatGetX(&orientation);
+  double const y = osvrQuatGetY(&orientation), z = osvrQuatGetZ(&orientation);
+  pose.yaw = static_cast<float>(std::atan2(2 * (w*y + x*z), 1 - 2 * (x*x + y*y)));
+  pose.pitch = static_cast<float>(std::asin(std::max(-1.0, std::min(1.0, 2 * (w*x - y*z)))));
+  pose.roll = static_cast<float>(std::atan2(2 * (w*z + x*y), 1 - 2 * (x*x + z*z)));
+  return true;
+}
+#endif
+
+pose_reprojection::pose_reprojection(pose_source& source, float field_of_view)
+  : source(source), field_of_view(field_of_view * DEGREES) {}
+
+void pose_reprojection::record(head_pose const& pose) {
+  history[history_next] = pose;
+  history_next = (history_next + 1) % HISTORY;
+  if (history_count < HISTORY) { history_count++; }
+}
+
+void pose_reprojection::sample() {
+  head_pose pose;
+  if (source.sample(pose)) { record(pose); }
+}
+
+head_pose pose_reprojection::poseAt(clock::time_point t) const {
+/*walk back from the newest sample to the first one at or before t and interpolate towards its successor*/
+  int const newest = (history_next + HISTORY - 1) % HISTORY;
+  head_pose after = history[newest];
+  if (after.timestamp <= t) { return after; }
+  for (int i = 1; i < history_count; i++) {
+    head_pose const& before = history[(newest - i + HISTORY) % HISTORY];
+    if (before.timestamp <= t) {
+      if (after.timestamp <= before.timestamp) { return before; }
+      float const f = std::chrono::duration<float>(t - before.timestamp).count() /
+                      std::chrono::duration<float>(after.timestamp - before.timestamp).count();
+      head_pose pose;
+      pose.yaw = before.yaw + f * angleDelta(after.yaw, before.yaw);
+      pose.pitch = before.pitch + f * angleDelta(after.pitch, before.pitch);
+      pose.roll = before.roll + f * angleDelta(after.roll, before.roll);
+      pose.timestamp = t;
+      return pose;
+    }
+    after = before;
+  }
+/*older than the history, the oldest pose is the best guess*/
+  return after;
+}
+
+void pose_reprojection::setFrameTime(clock::time_point captured) {
+  if (history_count == 0) { return; }
+  frame_pose = poseAt(captured);
+  has_frame_pose = true;
+}
+
+void pose_reprojection::latch(int window_w, int window_h) {
+  TRACE_SCOPE("pose latch");
+  head_pose now;
+  if (!has_frame_pose || !source.sample(now)) { clearReprojection(); return; }
+  record(now);
+  latch_count++;
+
+/*turning left moves the scene right on screen, looking up moves it down, and rolling
+  counterclockwise turns it clockwise; the camera is a pinhole with the given field of view*/
+  float const focal = 0.5f * window_w / std::tan(0.5f * field_of_view);
+  float const dx = focal * std::tan(angleDelta(now.yaw, frame_pose.yaw));
+  float const dy = focal * std::tan(angleDelta(now.pitch, frame_pose.pitch));
+  float const angle = angleDelta(now.roll, frame_pose.roll);
+  max_shift = std::max(max_shift, std::sqrt(dx*dx + dy*dy));
+  TRACE_COUNTER("reprojection px", 0, std::lround(std::sqrt(dx*dx + dy*dy)));
+  setReprojection(dx, dy, angle, window_w, window_h);
+}
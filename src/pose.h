@@ -0,0 +1,94 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef POSE_H
+#define POSE_H
+
+/*head orientation in radians: yaw turns left, pitch looks up, roll tilts counterclockwise*/
+struct head_pose {
+  float yaw = 0, pitch = 0, roll = 0;
+  std::chrono::steady_clock::time_point timestamp;
+};
+
+/*where head poses come from, the tracker of an HMD or a script standing in for it*/
+class pose_source {
+public:
+  virtual ~pose_source() {}
+/*the pose right now, false if the tracker has none*/
+  virtual bool sample(head_pose& pose) = 0;
+};
+
+/*deterministic head motion for testing and benchmarking without a tracker:
+  yaw, pitch and roll swing at different rates, AMPLITUDE degrees at most*/
+class scripted_pose_source : public pose_source {
+public:
+  scripted_pose_source(float amplitude, float frequency);
+  bool sample(head_pose& pose) override;
+
+private:
+  float const amplitude, frequency; //radians, Hz
+  std::chrono::steady_clock::time_point const start;
+};
+
+/*opens "script[:AMPLITUDE[@HZ]]" (default 10 degrees at 0.5 Hz), NULL if the spec is not a script*/
+std::unique_ptr<pose_source> openScriptedPoseSource(std::string const& spec);
+
+/*parses the horizontal field of view of the camera in degrees, which must be between 0 and 180*/
+bool parseFieldOfView(std::string const& spec, float& degrees);
+
+#ifndef DISABLE_OSVR
+/*the head orientation from the OSVR server, updated on every sample so it is as recent as it gets*/
+class osvr_pose_source : public pose_source {
+public:
+  explicit osvr_pose_source(osvr::clientkit::ClientContext& ctx);
+  bool sample(head_pose& pose) override;
+
+private:
+  osvr::clientkit::ClientContext& ctx;
+  osvr::clientkit::Interface head;
+};
+#endif
+
+/*moves the last video frame and its overlay by the head motion since the frame was captured:
+  the pose is recorded every loop iteration so the pose at a capture time can be looked up later,
+  and latched again right before each eye is drawn*/
+class pose_reprojection {
+public:
+  typedef std::chrono::steady_clock clock;
+
+/*FIELD_OF_VIEW is the horizontal field of view of the camera in degrees*/
+  pose_reprojection(pose_source& source, float field_of_view);
+
+/*records the current pose*/
+  void sample();
+/*the frame about to be drawn was captured at CAPTURED*/
+  void setFrameTime(clock::time_point captured);
+/*samples the pose once more and sets the matching reprojection for the next draw calls*/
+  void latch(int window_w, int window_h);
+
+  unsigned long latches() const { return latch_count; }
+/*the largest correction so far, in pixels*/
+  float maxShift() const { return max_shift; }
+
+private:
+  static const int HISTORY = 128;
+
+  void record(head_pose const& pose);
+  head_pose poseAt(clock::time_point t) const;
+
+  pose_source& source;
+  float const field_of_view;
+
+  head_pose history[HISTORY];
+  int history_count = 0, history_next = 0;
+  head_pose frame_pose;
+  bool has_frame_pose = false;
+
+  unsigned long latch_count = 0;
+  float max_shift = 0;
+};
+
+#endif //POSE_H
@@ -0,0 +1,160 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "preprocess.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+/*dividing in single precision rounds exactly like the reference's double division followed by a
+  conversion to float for every value 0-255, so all paths below produce identical results*/
+
+static void convertRowScalar(const unsigned char* src, int width, float* r, float* g, float* b) {
+  for (int x = 0; x < width; x++) {
+    b[x] = src[x*3 + 0] / 255.0f;
+    g[x] = src[x*3 + 1] / 255.0f;
+    r[x] = src[x*3 + 2] / 255.0f;
+  }
+}
+
+#ifdef HAVE_X86_SIMD
+
+/*gathers the three channels of 16 BGR pixels out of three 16-byte loads with pshufb*/
+__attribute__((target("ssse3")))
+static inline void deinterleave(const unsigned char* src, __m128i& b, __m128i& g, __m128i& r) {
+  __m128i const a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+  __m128i const a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+  __m128i const a2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+
+  b = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a0, _mm_setr_epi8( 0, 3, 6, 9,12,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1)),
+        _mm_shuffle_epi8(a1, _mm_setr_epi8(-1,-1,-1,-1,-1,-1, 2, 5, 8,11,14,-1,-1,-1,-1,-1))),
+        _mm_shuffle_epi8(a2, _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, 1, 4, 7,10,13)));
+  g = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a0, _mm_setr_epi8( 1, 4, 7,10,13,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1)),
+        _mm_shuffle_epi8(a1, _mm_setr_epi8(-1,-1,-1,-1,-1, 0, 3, 6, 9,12,15,-1,-1,-1,-1,-1))),
+        _mm_shuffle_epi8(a2, _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, 2, 5, 8,11,14)));
+  r = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a0, _mm_setr_epi8( 2, 5, 8,11,14,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1)),
+        _mm_shuffle_epi8(a1, _mm_setr_epi8(-1,-1,-1,-1,-1, 1, 4, 7,10,13,-1,-1,-1,-1,-1,-1))),
+        _mm_shuffle_epi8(a2, _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, 0, 3, 6, 9,12,15)));
+}
+
+__attribute__((target("sse4.1")))
+static inline void storeNormalizedSSE(__m128i bytes, float* dst, __m128 scale) {
+  for (int i = 0; i < 4; i++) {
+    __m128 const values = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes));
+    _mm_storeu_ps(dst + i*4, _mm_div_ps(values, scale));
+    bytes = _mm_srli_si128(bytes, 4);
+  }
+}
+
+__attribute__((target("sse4.1")))
+static void convertRowSSE(const unsigned char* src, int width, float* r, float* g, float* b) {
+  __m128 const scale = _mm_set1_ps(255.0f);
+  int x = 0;
+  for (; x + 16 <= width; x += 16, src += 48) {
+    __m128i blue, green, red;
+    deinterleave(src, blue, green, red);
+    storeNormalizedSSE(red, r + x, scale);
+    storeNormalizedSSE(green, g + x, scale);
+    storeNormalizedSSE(blue, b + x, scale);
+  }
+  convertRowScalar(src, width - x, r + x, g + x, b + x);
+}
+
+__attribute__((target("avx2")))
+static inline void storeNormalizedAVX2(__m128i bytes, float* dst, __m256 scale) {
+  __m256 const low = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+  __m256 const high = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+  _mm256_storeu_ps(dst, _mm256_div_ps(low, scale));
+  _mm256_storeu_ps(dst + 8, _mm256_div_ps(high, scale));
+}
+
+__attribute__((target("avx2")))
+static void convertRowAVX2(const unsigned char* src, int width, float* r, float* g, float* b) {
+  __m256 const scale = _mm256_set1_ps(255.0f);
+  int x = 0;
+  for (; x + 16 <= width; x += 16, src += 48) {
+    __m128i blue, green, red;
+    deinterleave(src, blue, green, red);
+    storeNormalizedAVX2(red, r + x, scale);
+    storeNormalizedAVX2(green, g + x, scale);
+    storeNormalizedAVX2(blue, b + x, scale);
+  }
+  convertRowScalar(src, width - x, r + x, g + x, b + x);
+}
+
+#endif //HAVE_X86_SIMD
+
+typedef void (*convert_row_fn)(const unsigned char*, int, float*, float*, float*);
+
+static convert_row_fn selectConvertRow() {
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) { return convertRowAVX2; }
+  if (__builtin_cpu_supports("sse4.1")) { return convertRowSSE; }
+#endif
+  return convertRowScalar;
+}
+
+static void convertImage(convert_row_fn convert_row, const unsigned char* src, size_t src_step, int width, int height, float* dst) {
+  size_t const plane = static_cast<size_t>(width) * height;
+  for (int y = 0; y < height; y++) {
+    size_t const offset = static_cast<size_t>(y) * width;
+    convert_row(src + y * src_step, width, dst + offset, dst + plane + offset, dst + 2*plane + offset);
+  }
+}
+
+void bgrToPlanarRgb(const unsigned char* src, size_t src_step, int width, int height, float* dst) {
+  static const convert_row_fn convert_row = selectConvertRow();
+  convertImage(convert_row, src, src_step, width, height, dst);
+}
+
+bool bgrToPlanarRgb(convert_kernel kernel, const unsigned char* src, size_t src_step, int width, int height, float* dst) {
+  convert_row_fn convert_row = convertRowScalar;
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if (kernel == convert_kernel::avx2) {
+    if (!__builtin_cpu_supports("avx2")) { return false; }
+    convert_row = convertRowAVX2;
+  } else if (kernel == convert_kernel::sse41) {
+    if (!__builtin_cpu_supports("sse4.1")) { return false; }
+    convert_row = convertRowSSE;
+  }
+#else
+  if (kernel != convert_kernel::scalar) { return false; }
+#endif
+  convertImage(convert_row, src, src_step, width, height, dst);
+  return true;
+}
+
+detector_input::detector_input(int width, int height) {
+  tensor.w = width;
+  tensor.h = height;
+  tensor.c = 3;
+  void* buffer = NULL;
+  if (posix_memalign(&buffer, 64, static_cast<size_t>(width) * height * 3 * sizeof(float)) != 0) { throw std::bad_alloc(); }
+  tensor.data = static_cast<float*>(buffer);
+  resized_frame.create(height, width, CV_8UC3);
+}
+
+detector_input::~detector_input() {
+  std::free(tensor.data);
+}
+
+void detector_input::resize(cv::Mat const& frame) {
+  if (frame.cols == tensor.w && frame.rows == tensor.h) { frame.copyTo(resized_frame); }
+  else { cv::resize(frame, resized_frame, cv::Size(tensor.w, tensor.h)); }
+}
+
+image_t const& detector_input::convert() {
+  bgrToPlanarRgb(resized_frame.data, resized_frame.step, tensor.w, tensor.h, tensor.data);
+  return tensor;
+}
@@ -0,0 +1,45 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef PREPROCESS_H
+#define PREPROCESS_H
+
+#include "yolo_v2_class.hpp"
+
+/*converts interleaved 8-bit BGR pixels into planar RGB floats in [0, 1];
+  the output is bit-identical to Detector::mat_to_image()*/
+void bgrToPlanarRgb(const unsigned char* src, size_t src_step, int width, int height, float* dst);
+
+/*the row kernels bgrToPlanarRgb() picks from at runtime*/
+enum class convert_kernel { scalar, sse41, avx2 };
+/*converts with the given kernel instead of the fastest one, so the kernels can be checked against
+  each other; returns false if the CPU does not support it*/
+bool bgrToPlanarRgb(convert_kernel kernel, const unsigned char* src, size_t src_step, int width, int height, float* dst);
+
+/*a preallocated detector input, so that preparing a frame for inference does not allocate*/
+class detector_input {
+public:
+  detector_input(int width, int height);
+  ~detector_input();
+
+  detector_input(const detector_input&) = delete;
+  detector_input& operator=(const detector_input&) = delete;
+
+/*scales the frame to the network input size*/
+  void resize(cv::Mat const& frame);
+/*converts the resized frame into the input tensor*/
+  image_t const& convert();
+  image_t const& convert(cv::Mat const& frame) { resize(frame); return convert(); }
+
+  cv::Mat const& resized() const { return resized_frame; }
+  image_t const& image() const { return tensor; }
+
+private:
+  cv::Mat resized_frame;
+  image_t tensor;
+};
+
+#endif //PREPROCESS_H
@@ -0,0 +1,141 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "recorder.h"
+#include "trace.h"
+
+bool parseRecordPolicy(std::string const& spec, record_policy& policy, int& queue_length) {
+  std::string const name = spec.substr(0, spec.find(':'));
+  if (name == "newest") { policy = record_policy::drop_newest; }
+  else if (name == "oldest") { policy = record_policy::drop_oldest; }
+  else { return false; }
+  if (name.size() < spec.size()) {
+    int const length = std::atoi(spec.c_str() + name.size() + 1);
+    if (length <= 0) { return false; }
+    queue_length = length;
+  }
+  return true;
+}
+
+bool parseRecordFps(std::string const& spec, double& fps) {
+  char* end;
+  double const value = std::strtod(spec.c_str(), &end);
+  if (end == spec.c_str() || *end != '\0' || !(value > 0)) { return false; }
+  fps = value;
+  return true;
+}
+
+video_recorder::video_recorder(recorder_options const& options)
+  : options(options) {}
+
+video_recorder::~video_recorder() {
+  stop();
+}
+
+bool video_recorder::start(cv::Size size) {
+  if (options.fourcc.size() != 4 || options.fps <= 0) { return false; }
+  std::string const& c = options.fourcc;
+  writer.open(options.path, CV_FOURCC(c[0], c[1], c[2], c[3]), options.fps, size, true);
+  if (!writer.isOpened()) { return false; }
+
+/*one buffer per queue entry, plus the one being encoded*/
+  buffers.reset(new frame_pool(options.queue_length + 1, size));
+  running = true;
+  thread = std::thread(&video_recorder::run, this);
+  return true;
+}
+
+void video_recorder::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+  }
+  not_empty.notify_all();
+  if (thread.joinable()) { thread.join(); }
+  writer.release();
+}
+
+int video_recorder::acquire() {
+  frames_submitted++;
+  int slot = buffers->tryAcquire();
+  if (slot < 0 && options.policy == record_policy::drop_oldest) {
+/*take over the buffer of the oldest frame still waiting for the encoder*/
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!jobs.empty()) {
+      slot = jobs.front().slot;
+      jobs.pop_front();
+      frames_dropped++;
+      return slot;
+    }
+  }
+  if (slot < 0) { frames_dropped++; }
+  return slot;
+}
+
+void video_recorder::push(int slot, clock::time_point captured) {
+  image_data job;
+  job.slot = slot;
+  job.frame = buffers->frame(slot);
+  job.timestamp = captured;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.push_back(job);
+  }
+  not_empty.notify_one();
+}
+
+int video_recorder::queued() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return static_cast<int>(jobs.size());
+}
+
+void video_recorder::run() {
+  traceThreadName("recorder");
+  for (;;) {
+    image_data job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      not_empty.wait(lock, [&] { return !running || !jobs.empty(); });
+      if (jobs.empty()) { break; } //stopped and drained
+      job = jobs.front();
+      jobs.pop_front();
+      TRACE_COUNTER("record queue", 0, static_cast<long>(jobs.size()));
+    }
+    encode(job);
+    buffers->release(job.slot);
+  }
+}
+
+void video_recorder::encode(image_data const& job) {
+  if (!has_first) {
+    first_capture = job.timestamp;
+    has_first = true;
+  }
+
+/*the output slot this frame belongs in on a constant frame rate timeline*/
+  long const index = std::lround(std::chrono::duration<double>(job.timestamp - first_capture).count() * options.fps);
+  if (index < next_index) {
+    frames_merged++;
+    return;
+  }
+
+/*a gap longer than a second (a stalled camera, a suspended machine) is not filled: that would keep
+  the encoder busy long enough to drop everything pushed meanwhile; the slots past a second are
+  skipped and the timeline carries on from this frame*/
+  long repeats = index - next_index;
+  long const max_repeats = std::max(1L, std::lround(options.fps));
+  if (repeats > max_repeats) {
+    frames_skipped += repeats - max_repeats;
+    repeats = max_repeats;
+  }
+
+  TRACE_SCOPE("encode");
+  for (long i = 0; i <= repeats; i++) { writer.write(job.frame); }
+  frames_written += repeats + 1;
+  frames_repeated += repeats;
+  next_index = index + 1;
+}
@@ -0,0 +1,92 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "framequeue.h"
+
+enum class record_policy {
+  drop_newest, //a frame that finds the queue full is not recorded
+  drop_oldest  //a frame that finds the queue full replaces the oldest waiting one
+};
+
+/*parses "newest" or "oldest", optionally followed by ":N" for the queue length*/
+bool parseRecordPolicy(std::string const& spec, record_policy& policy, int& queue_length);
+/*parses the frame rate of the recording, which must be positive*/
+bool parseRecordFps(std::string const& spec, double& fps);
+
+struct recorder_options {
+  std::string path = "result.avi"; //the container follows the extension
+  std::string fourcc = "DIVX";
+  double fps = 30;
+  record_policy policy = record_policy::drop_newest;
+  int queue_length = 8;
+};
+
+/*encodes frames on its own thread; the caller copies each frame into one of the recorder's buffers
+  and never waits for the encoder, a full queue drops frames according to the policy.
+  Frames are placed on a constant frame rate timeline by their capture time: a gap is filled by
+  repeating the next frame, for at most a second, and a frame landing on an output slot that is
+  already taken is left out*/
+class video_recorder {
+public:
+  typedef std::chrono::steady_clock clock;
+
+  explicit video_recorder(recorder_options const& options);
+  ~video_recorder();
+
+  video_recorder(const video_recorder&) = delete;
+  video_recorder& operator=(const video_recorder&) = delete;
+
+/*opens the output file and starts the encoder thread*/
+  bool start(cv::Size size);
+/*encodes the frames still queued and closes the file*/
+  void stop();
+  bool isOpen() const { return running.load(); }
+
+/*a buffer for the next frame, -1 if the frame has to be dropped*/
+  int acquire();
+  cv::Mat frame(int slot) const { return buffers->frame(slot); }
+/*queues the buffer for encoding*/
+  void push(int slot, clock::time_point captured);
+
+  int queued();
+  unsigned long submitted() const { return frames_submitted.load(); }
+  unsigned long dropped() const { return frames_dropped.load(); }
+  unsigned long written() const { return frames_written.load(); }
+  unsigned long repeated() const { return frames_repeated.load(); }
+  unsigned long merged() const { return frames_merged.load(); }
+  unsigned long skipped() const { return frames_skipped.load(); } //output slots of long gaps left out
+
+private:
+  void run();
+  void encode(image_data const& job);
+
+  recorder_options const options;
+  cv::VideoWriter writer;
+  std::unique_ptr<frame_pool> buffers;
+
+  std::mutex mutex;
+  std::condition_variable not_empty;
+  std::deque<image_data> jobs;
+  std::atomic<bool> running{false};
+  std::thread thread;
+
+/*the output timeline, only touched by the encoder thread*/
+  clock::time_point first_capture;
+  bool has_first = false;
+  long next_index = 0;
+
+  std::atomic<unsigned long> frames_submitted{0};
+  std::atomic<unsigned long> frames_dropped{0};
+  std::atomic<unsigned long> frames_written{0};
+  std::atomic<unsigned long> frames_repeated{0};
+  std::atomic<unsigned long> frames_merged{0};
+  std::atomic<unsigned long> frames_skipped{0};
+};
+
+#endif //RECORDER_H
@@ -6,11 +6,281 @@
 
 #include "globals.h"
 #include "rendering.h"
+#include "text.h"
+#include "pose.h"
 
 extern Globals global;
 
+/*shader programs and static geometry, created once for the current GL context*/
+static struct {
+  GLuint video_program = 0;
+  GLuint color_program = 0;
+  GLint video_projection, video_rect, video_flip, video_frame;
+  GLint color_projection, color_rect, color_color;
+  GLuint quad_vao = 0, quad_vbo = 0;
+  GLuint circle_vao = 0, circle_vbo = 0;
+  GLuint overlay_program = 0;
+  GLint overlay_projection, overlay_scale, overlay_frame_height, overlay_flip;
+  GLuint overlay_vao = 0, overlay_vbo = 0;
+  size_t overlay_capacity = 0, overlay_count = 0;
+  int overlay_frame_w = 1, overlay_frame_h = 1;
+  GLfloat projection[16];
+  GLfloat reprojected[16]; //projection of the video and its overlay, moved with the head since capture
+} gl;
+
+static const int circle_points = 100;
+
+/*positions are in pixels, top-left origin, like the old glOrtho setup*/
+static const char* const quad_vertex_shader = R"(
+#version 330 core
+layout(location = 0) in vec2 position;
+uniform mat4 projection;
+uniform vec4 rect;
+uniform bool flip;
+out vec2 uv;
+void main() {
+  uv = vec2(position.x, flip ? 1.0 - position.y : position.y);
+  gl_Position = projection * vec4(rect.xy + position * rect.zw, 0.0, 1.0);
+}
+)";
+
+/*frames are uploaded as raw BGR bytes, the swizzle happens here*/
+static const char* const video_fragment_shader = R"(
+#version 330 core
+in vec2 uv;
+uniform sampler2D frame;
+out vec4 color;
+void main() {
+  color = vec4(texture(frame, uv).bgr, 1.0);
+}
+)";
+
+static const char* const color_fragment_shader = R"(
+#version 330 core
+uniform vec4 shape_color;
+out vec4 color;
+void main() {
+  color = shape_color;
+}
+)";
+
+/*detection boxes, circles and label backgrounds, one instance per primitive, all in one draw call;
+  shapes are cut out of their bounding quad in the fragment shader*/
+static const char* const overlay_vertex_shader = R"(
+#version 330 core
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec4 rect;
+layout(location = 2) in vec4 color;
+layout(location = 3) in vec2 style;
+uniform mat4 projection;
+uniform vec2 scale;
+uniform float frame_height;
+uniform bool flip;
+out vec2 local;
+flat out vec2 half_size;
+flat out vec4 shape_color;
+flat out vec2 shape_style;
+void main() {
+  float margin = (style.x == 2.0) ? 0.0 : style.y * 0.5;
+  half_size = rect.zw * 0.5;
+  local = (position - 0.5) * (rect.zw + 2.0 * margin);
+  vec2 p = rect.xy + half_size + local;
+  if (flip) { p.y = frame_height - p.y; }
+  shape_color = color;
+  shape_style = style;
+  gl_Position = projection * vec4(p * scale, 0.0, 1.0);
+}
+)";
+
+static const char* const overlay_fragment_shader = R"(
+#version 330 core
+in vec2 local;
+flat in vec2 half_size;
+flat in vec4 shape_color;
+flat in vec2 shape_style;
+out vec4 color;
+void main() {
+  float margin = shape_style.y * 0.5;
+  if (shape_style.x == 0.0) {
+    vec2 d = abs(local) - half_size;
+    if (abs(max(d.x, d.y)) > margin) { discard; }
+  } else if (shape_style.x == 1.0) {
+    if (abs(length(local) - half_size.y) > margin) { discard; }
+  }
+  color = shape_color;
+}
+)";
+
+static GLuint compileShader(GLenum type, const char* source) {
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+
+  GLint status;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (!status) {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    std::fprintf(stderr, "Failed to compile shader: %s\n", log);
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+GLuint linkProgram(const char* vertex_source, const char* fragment_source) {
+  GLuint vertex = compileShader(GL_VERTEX_SHADER, vertex_source);
+  GLuint fragment = compileShader(GL_FRAGMENT_SHADER, fragment_source);
+  if (!vertex || !fragment) {
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+    return 0;
+  }
+
+  GLuint program = glCreateProgram();
+  glAttachShader(program, vertex);
+  glAttachShader(program, fragment);
+  glLinkProgram(program);
+  glDeleteShader(vertex);
+  glDeleteShader(fragment);
+
+  GLint status;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (!status) {
+    char log[1024];
+    glGetProgramInfoLog(program, sizeof(log), NULL, log);
+    std::fprintf(stderr, "Failed to link shader program: %s\n", log);
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+static void createVertexArray(GLuint& vao, GLuint& vbo, std::vector<GLfloat> const& vertices) {
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool initRenderer(int window_w, int window_h) {
+  gl.video_program = linkProgram(quad_vertex_shader, video_fragment_shader);
+  gl.color_program = linkProgram(quad_vertex_shader, color_fragment_shader);
+  if (!gl.video_program || !gl.color_program) { return false; }
+
+  gl.video_projection = glGetUniformLocation(gl.video_program, "projection");
+  gl.video_rect = glGetUniformLocation(gl.video_program, "rect");
+  gl.video_flip = glGetUniformLocation(gl.video_program, "flip");
+  gl.video_frame = glGetUniformLocation(gl.video_program, "frame");
+  gl.color_projection = glGetUniformLocation(gl.color_program, "projection");
+  gl.color_rect = glGetUniformLocation(gl.color_program, "rect");
+  gl.color_color = glGetUniformLocation(gl.color_program, "shape_color");
+
+  gl.overlay_program = linkProgram(overlay_vertex_shader, overlay_fragment_shader);
+  if (!gl.overlay_program) { return false; }
+  gl.overlay_projection = glGetUniformLocation(gl.overlay_program, "projection");
+  gl.overlay_scale = glGetUniformLocation(gl.overlay_program, "scale");
+  gl.overlay_frame_height = glGetUniformLocation(gl.overlay_program, "frame_height");
+  gl.overlay_flip = glGetUniformLocation(gl.overlay_program, "flip");
+
+/*unit quad as a triangle strip*/
+  createVertexArray(gl.quad_vao, gl.quad_vbo, {0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f});
+
+/*unit circle as a triangle fan, scaled by the radius at draw time*/
+  std::vector<GLfloat> circle = {0.0f, 0.0f};
+  for (int i = 0; i <= circle_points; i++) {
+    double const angle = 2.0 * M_PI * i / circle_points;
+    circle.push_back(static_cast<GLfloat>(std::cos(angle)));
+    circle.push_back(static_cast<GLfloat>(std::sin(angle)));
+  }
+  createVertexArray(gl.circle_vao, gl.circle_vbo, circle);
+
+/*the overlay shares the unit quad and streams its per-instance attributes*/
+  glGenVertexArrays(1, &gl.overlay_vao);
+  glBindVertexArray(gl.overlay_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, gl.quad_vbo);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+  glGenBuffers(1, &gl.overlay_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, gl.overlay_vbo);
+  GLsizei const stride = sizeof(overlay_instance);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offsetof(overlay_instance, x)));
+  glVertexAttribDivisor(1, 1);
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offsetof(overlay_instance, r)));
+  glVertexAttribDivisor(2, 1);
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offsetof(overlay_instance, shape)));
+  glVertexAttribDivisor(3, 1);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  resizeRenderer(window_w, window_h);
+  return true;
+}
+
+GLfloat const* hudProjection() {
+  return gl.reprojected;
+}
+
+void setReprojection(float dx, float dy, float angle, int window_w, int window_h) {
+/*rotate by angle about the window center, then shift, all in window pixels: p' = R (p - c) + c + d*/
+  float const c = std::cos(angle), s = std::sin(angle);
+  float const cx = 0.5f * window_w, cy = 0.5f * window_h;
+  GLfloat const move[16] = {
+    c,                          s,                          0.0f, 0.0f,
+   -s,                          c,                          0.0f, 0.0f,
+    0.0f,                       0.0f,                       1.0f, 0.0f,
+    cx + dx - (c*cx - s*cy),    cy + dy - (s*cx + c*cy),    0.0f, 1.0f,
+  };
+  for (int col = 0; col < 4; col++) {
+    for (int row = 0; row < 4; row++) {
+      float sum = 0;
+      for (int k = 0; k < 4; k++) { sum += gl.projection[k*4 + row] * move[col*4 + k]; }
+      gl.reprojected[col*4 + row] = sum;
+    }
+  }
+}
+
+void clearReprojection() {
+  std::memcpy(gl.reprojected, gl.projection, sizeof(gl.projection));
+}
+
+void resizeRenderer(int window_w, int window_h) {
+/*orthographic projection, column-major, equivalent to glOrtho(0, w, h, 0, 0, 100)*/
+  GLfloat const projection[16] = {
+    2.0f / window_w, 0.0f,             0.0f,    0.0f,
+    0.0f,           -2.0f / window_h,  0.0f,    0.0f,
+    0.0f,            0.0f,            -0.02f,   0.0f,
+   -1.0f,            1.0f,            -1.0f,    1.0f,
+  };
+  std::memcpy(gl.projection, projection, sizeof(projection));
+  clearReprojection();
+}
+
+void destroyRenderer() {
+  glDeleteProgram(gl.video_program);
+  glDeleteProgram(gl.color_program);
+  glDeleteVertexArrays(1, &gl.quad_vao);
+  glDeleteBuffers(1, &gl.quad_vbo);
+  glDeleteVertexArrays(1, &gl.circle_vao);
+  glDeleteBuffers(1, &gl.circle_vbo);
+  glDeleteProgram(gl.overlay_program);
+  glDeleteVertexArrays(1, &gl.overlay_vao);
+  glDeleteBuffers(1, &gl.overlay_vbo);
+  gl.video_program = gl.color_program = gl.overlay_program = 0;
+  gl.quad_vao = gl.quad_vbo = gl.circle_vao = gl.circle_vbo = gl.overlay_vao = gl.overlay_vbo = 0;
+  gl.overlay_capacity = gl.overlay_count = 0;
+}
+
 #ifndef DISABLE_OSVR
-void render(osvr::clientkit::DisplayConfig &display, cv::Mat frame, GLuint texture, int window_w, int window_h) {
+void render(osvr::clientkit::DisplayConfig &display, video_texture const& video, int window_w, int window_h, pose_reprojection* reprojection) {
   glClearColor(0,0,0,1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   display.forEachEye([&](osvr::clientkit::Eye eye) {
@@ -21,7 +291,11 @@ void render(osvr::clientkit::DisplayConfig &display, cv::Mat frame, GLuint textu
                  static_cast<GLint>(viewport.bottom),
                  static_cast<GLsizei>(viewport.width),
                  static_cast<GLsizei>(viewport.height));
-      drawToGLFW(frame, texture, window_w, window_h);
+/*latch the head pose as late as possible, right before the eye is drawn*/
+      if (reprojection) { reprojection->latch(window_w, window_h); }
+      drawToGLFW(video, window_w, window_h);
+      drawOverlay(window_w, window_h);
+      drawText(window_w, window_h);
 
       if (global.flags.show_items) {
         if (eye_number == 0) { drawSquare(window_w/2.0f, window_h/2.0f, 200, 150); }
@@ -32,61 +306,128 @@ void render(osvr::clientkit::DisplayConfig &display, cv::Mat frame, GLuint textu
 }
 #endif
 
-void drawToGLFW(cv::Mat img, GLuint texture, int window_w, int window_h) {
+void createVideoTexture(video_texture& video, int width, int height) {
+  destroyVideoTexture(video);
 
-  glLoadIdentity();
-  glGenTextures(1, &texture);
-  glMatrixMode(GL_MODELVIEW);
-  glBindTexture(GL_TEXTURE_2D, texture);
+  video.width = width;
+  video.height = height;
+  video.size = static_cast<size_t>(width) * height * 3;
 
+  glGenTextures(1, &video.texture);
+  glBindTexture(GL_TEXTURE_2D, video.texture);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, img.size().width, img.size().height, 0, GL_BGR, GL_UNSIGNED_BYTE, img.data);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenBuffers(VIDEO_TEXTURE_PBO_COUNT, video.pbo);
+  for (int i = 0; i < VIDEO_TEXTURE_PBO_COUNT; i++) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, video.pbo[i]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, video.size, NULL, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
 
-  glEnable(GL_TEXTURE_2D);
+void uploadVideoTexture(video_texture& video, cv::Mat const& frame) {
+  if (frame.empty()) { return; }
+  if (frame.cols != video.width || frame.rows != video.height) { createVideoTexture(video, frame.cols, frame.rows); }
 
-  glColor4f(1.0f, 1.0f, 1.0f, 0.0f);
+/*write into the next buffer of the ring so we never wait on a transfer still in flight*/
+  video.pbo_index = (video.pbo_index + 1) % VIDEO_TEXTURE_PBO_COUNT;
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, video.pbo[video.pbo_index]);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, video.size, NULL, GL_STREAM_DRAW); //orphan the old storage
 
-  glBegin(GL_QUADS);
-    glTexCoord2i(0, 0); glVertex2i(0, 0);
-    glTexCoord2i(0, 1); glVertex2i(0, window_h);
-    glTexCoord2i(1, 1); glVertex2i(window_w, window_h);
-    glTexCoord2i(1, 0); glVertex2i(window_w, 0);
-  glEnd();
+  auto* pixels = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, video.size,
+                                                              GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+  if (pixels != NULL) {
+    size_t const row_size = static_cast<size_t>(video.width) * 3;
+    if (frame.isContinuous()) { std::memcpy(pixels, frame.data, video.size); }
+    else {
+      for (int y = 0; y < video.height; y++) { std::memcpy(pixels + y * row_size, frame.ptr(y), row_size); }
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
 
-  glDisable(GL_TEXTURE_2D);
-  glDeleteTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, video.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, video.width, video.height, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void destroyVideoTexture(video_texture& video) {
+  if (video.texture) { glDeleteTextures(1, &video.texture); }
+  if (video.pbo[0]) { glDeleteBuffers(VIDEO_TEXTURE_PBO_COUNT, video.pbo); }
+  video = video_texture();
+}
+
+void drawToGLFW(video_texture const& video, int window_w, int window_h) {
+  glUseProgram(gl.video_program);
+  glUniformMatrix4fv(gl.video_projection, 1, GL_FALSE, gl.reprojected);
+  glUniform4f(gl.video_rect, 0.0f, 0.0f, window_w, window_h);
+  glUniform1i(gl.video_flip, global.flags.flip_image);
+  glUniform1i(gl.video_frame, 0);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, video.texture);
+  glBindVertexArray(gl.quad_vao);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void setOverlay(std::vector<overlay_instance> const& instances, int frame_w, int frame_h) {
+  gl.overlay_count = instances.size();
+  gl.overlay_frame_w = frame_w;
+  gl.overlay_frame_h = frame_h;
+  if (instances.empty()) { return; }
+
+  size_t const bytes = instances.size() * sizeof(overlay_instance);
+  glBindBuffer(GL_ARRAY_BUFFER, gl.overlay_vbo);
+  if (bytes > gl.overlay_capacity) { gl.overlay_capacity = std::max(bytes, 2 * gl.overlay_capacity); }
+  glBufferData(GL_ARRAY_BUFFER, gl.overlay_capacity, NULL, GL_STREAM_DRAW); //grow or orphan the old storage
+  glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances.data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void drawOverlay(int window_w, int window_h) {
+  if (gl.overlay_count == 0) { return; }
+
+  glUseProgram(gl.overlay_program);
+  glUniformMatrix4fv(gl.overlay_projection, 1, GL_FALSE, gl.reprojected);
+  glUniform2f(gl.overlay_scale, static_cast<float>(window_w) / gl.overlay_frame_w,
+              static_cast<float>(window_h) / gl.overlay_frame_h);
+  glUniform1f(gl.overlay_frame_height, static_cast<float>(gl.overlay_frame_h));
+  glUniform1i(gl.overlay_flip, global.flags.flip_image);
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glBindVertexArray(gl.overlay_vao);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(gl.overlay_count));
+  glBindVertexArray(0);
+  glDisable(GL_BLEND);
 }
 
 void drawSquare(float x, float y, int w, int h) {
-  x -= h/2; //to center the square
-  y -= w/2;
-  glBegin(GL_POLYGON);
-  glColor4f(0.0f, 0.0f, 0.0f, 0.0f);
-  glVertex3f(x,y,0);
-  glVertex3f(x+w,y,0);
-  glVertex3f(x+w,y+h,0);
-  glVertex3f(x,y+h,0);
-  glEnd();
+  x -= w/2; //to center the square
+  y -= h/2;
+  glUseProgram(gl.color_program);
+  glUniformMatrix4fv(gl.color_projection, 1, GL_FALSE, gl.projection);
+  glUniform4f(gl.color_rect, x, y, w, h);
+  glUniform4f(gl.color_color, 0.0f, 0.0f, 0.0f, 0.0f);
+  glBindVertexArray(gl.quad_vao);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  glBindVertexArray(0);
 }
 
 void drawCircle(float x, float y, float radius) {
-
-  glMatrixMode(GL_MODELVIEW);
-  glPushMatrix();
-  glLoadIdentity();
-  glTranslatef(x, y, 0.0f);
-  static const int circle_points = 100;
-  static const float angle = 2.0f * 3.1416f / circle_points;
-
-  glColor4f(0.0f, 0.0f, 0.0f, 0.0f);
-  glBegin(GL_POLYGON);
-  double angle1 = 0.0;
-  glVertex2d(radius * cos(0.0) , radius * sin(0.0));
-  for (int i=0; i < circle_points; i++) {
-    glVertex2d(radius * cos(angle1), radius *sin(angle1));
-    angle1 += angle;
-  }
-  glEnd();
-  glPopMatrix();
+  glUseProgram(gl.color_program);
+  glUniformMatrix4fv(gl.color_projection, 1, GL_FALSE, gl.projection);
+  glUniform4f(gl.color_rect, x, y, radius, radius);
+  glUniform4f(gl.color_color, 0.0f, 0.0f, 0.0f, 0.0f);
+  glBindVertexArray(gl.circle_vao);
+  glDrawArrays(GL_TRIANGLE_FAN, 0, circle_points + 2);
+  glBindVertexArray(0);
 }
@@ -7,10 +7,56 @@
 #ifndef RENDERING_H
 #define RENDERING_H
 
+/*number of pixel buffer objects cycled through for streaming uploads*/
+#define VIDEO_TEXTURE_PBO_COUNT 3
+
+/*persistent texture holding the current video frame, shared by both eyes*/
+struct video_texture {
+  GLuint texture = 0;
+  GLuint pbo[VIDEO_TEXTURE_PBO_COUNT] = {};
+  int pbo_index = 0;
+  int width = 0, height = 0;
+  size_t size = 0;
+};
+
+enum overlay_shape {
+  OVERLAY_RECTANGLE = 0, //outline
+  OVERLAY_CIRCLE = 1,    //outline of the circle inscribed in the rectangle's height
+  OVERLAY_FILL = 2       //filled rectangle
+};
+
+/*one HUD primitive, in video frame pixel coordinates*/
+struct overlay_instance {
+  float x, y, w, h;
+  float r, g, b, a;
+  float shape, thickness;
+};
+
+bool initRenderer(int window_w, int window_h);
+void resizeRenderer(int window_w, int window_h);
+void destroyRenderer();
+GLuint linkProgram(const char* vertex_source, const char* fragment_source);
+/*the window-sized orthographic projection shared by the video and the HUD layers on top of it*/
+GLfloat const* hudProjection();
+/*moves the video and its HUD by DX, DY pixels and rotates them by ANGLE radians (clockwise on screen)
+  about the window center, until the next call or clearReprojection(); on-screen items stay put*/
+void setReprojection(float dx, float dy, float angle, int window_w, int window_h);
+void clearReprojection();
+
+void createVideoTexture(video_texture& video, int width, int height);
+void uploadVideoTexture(video_texture& video, cv::Mat const& frame);
+void destroyVideoTexture(video_texture& video);
+
+class pose_reprojection;
+
 #ifndef DISABLE_OSVR
-void render(osvr::clientkit::DisplayConfig &display, cv::Mat frame, GLuint texture, int window_w, int window_h);
+/*REPROJECTION, if given, is latched before every eye*/
+void render(osvr::clientkit::DisplayConfig &display, video_texture const& video, int window_w, int window_h,
+            pose_reprojection* reprojection = NULL);
 #endif
-void drawToGLFW(cv::Mat img, GLuint texture, int window_w, int window_h);
+void drawToGLFW(video_texture const& video, int window_w, int window_h);
+void setOverlay(std::vector<overlay_instance> const& instances, int frame_w, int frame_h);
+void drawOverlay(int window_w, int window_h);
 void drawSquare(float x, float y, int w, int h);
 void drawCircle(float cx, float cy, float r);
 
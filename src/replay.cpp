@@ -0,0 +1,144 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "replay.h"
+
+extern Globals global;
+
+bool parseReplaySpec(std::string const& spec, std::string& path, double& speed) {
+  if (spec.compare(0, 7, "replay:") != 0) { return false; }
+  path = spec.substr(7);
+  speed = 1.0;
+  size_t const at = path.rfind('@');
+  if (at != std::string::npos) {
+    char* end = NULL;
+    double const value = std::strtod(path.c_str() + at + 1, &end);
+    if (at + 1 < path.size() && *end == '\0') {
+      if (value < 0) { return false; }
+      speed = value;
+      path.resize(at);
+    }
+  }
+  return !path.empty();
+}
+
+replay_source::replay_source(std::string const& path, double speed)
+  : speed(speed) {
+  if (log.open(path)) {
+    is_log = true;
+    for (size_t i = 0; i < log.frameCount(); i++) {
+      if (log.entry(i).stream == 0) { log_frames.push_back(i); }
+    }
+  } else {
+    preload(path);
+  }
+}
+
+void replay_source::preload(std::string const& path) {
+  cv::VideoCapture capture(path);
+  if (!capture.isOpened()) { return; }
+  for (;;) {
+    cv::Mat frame;
+    if (!capture.read(frame) || frame.empty()) { break; }
+    clip_timestamps.push_back(static_cast<std::int64_t>(capture.get(cv::CAP_PROP_POS_MSEC) * 1000.0));
+    clip.push_back(frame);
+  }
+}
+
+std::int64_t replay_source::timestamp(size_t i) const {
+  return is_log ? log.entry(log_frames[i]).timestamp_us : clip_timestamps[i];
+}
+
+double replay_source::frameRate() const {
+/*the average over the whole recording, it has no nominal rate*/
+  size_t const n = frameCount();
+  if (n < 2) { return 0; }
+  std::int64_t const span_us = timestamp(n - 1) - timestamp(0);
+  return span_us > 0 ? (n - 1) * 1e6 / span_us : 0;
+}
+
+void replay_source::read(cv::Mat& frame) {
+  if (next >= frameCount()) {
+    frame.release(); //the end of the replay
+    return;
+  }
+
+/*frame n is due at its recorded time after the first one, scaled by the speed*/
+  if (next == 0) { started = std::chrono::steady_clock::now(); }
+  else if (speed > 0) {
+    double const due_us = (timestamp(next) - timestamp(0)) / speed;
+    std::this_thread::sleep_until(started + std::chrono::microseconds(static_cast<std::int64_t>(due_us)));
+  }
+
+  if (is_log) {
+    session_frame recorded;
+    if (log.frame(log_frames[next], recorded)) { recorded.image.copyTo(frame); }
+    else { frame.release(); }
+  } else {
+    clip[next].copyTo(frame);
+  }
+  next++;
+}
+
+bool session_replay::open(std::string const& path) {
+  if (!log.open(path)) { return false; }
+  for (size_t i = 0; i < log.frameCount(); i++) {
+    if (log.entry(i).stream == 0) { log_frames.push_back(i); }
+  }
+  inputs = log.inputs();
+  return true;
+}
+
+void session_replay::replayInput(unsigned long frame_id) {
+  if (frame_id >= log_frames.size()) { return; }
+  std::int64_t const captured = log.entry(log_frames[frame_id]).timestamp_us;
+  auto const now = std::chrono::steady_clock::now();
+  for (; next_input < inputs.size() && inputs[next_input].timestamp_us <= captured; next_input++) {
+    session_input const& e = inputs[next_input];
+    global.input_events.push(control_event{static_cast<control_event::event_type>(e.type), e.code, e.scancode,
+                                           e.action, e.modifiers, e.xpos, e.ypos, now});
+  }
+}
+
+/*intersection over union*/
+static float overlap(session_box const& a, session_box const& b) {
+  float const x0 = std::max(a.x, b.x), y0 = std::max(a.y, b.y);
+  float const x1 = std::min(a.x + a.w, b.x + b.w), y1 = std::min(a.y + a.h, b.y + b.h);
+  if (x1 <= x0 || y1 <= y0) { return 0.0f; }
+  float const common = (x1 - x0) * (y1 - y0);
+  return common / (float(a.w) * a.h + float(b.w) * b.h - common);
+}
+
+void session_replay::compare(unsigned long frame_id, std::vector<session_box> const& boxes, std::ostream* report) {
+  if (frame_id >= log_frames.size()) { return; }
+  session_frame recorded;
+  if (!log.frame(log_frames[frame_id], recorded)) { return; }
+
+/*greedy matching is enough here, the question is only whether anything changed*/
+  std::vector<bool> used(recorded.box_count, false);
+  unsigned long matched = 0;
+  for (auto const& box : boxes) {
+    for (size_t j = 0; j < recorded.box_count; j++) {
+      if (!used[j] && recorded.boxes[j].obj_id == box.obj_id && overlap(recorded.boxes[j], box) >= 0.5f) {
+        used[j] = true;
+        matched++;
+        break;
+      }
+    }
+  }
+  unsigned long const missing = recorded.box_count - matched;
+  unsigned long const extra = boxes.size() - matched;
+
+  totals.frames++;
+  totals.matched += matched;
+  totals.missing += missing;
+  totals.extra += extra;
+  if (missing || extra) {
+    totals.differing++;
+    if (report) { *report << "frame " << frame_id << ": " << matched << " matched, " << missing << " missing, " << extra << " extra\n"; }
+  }
+}
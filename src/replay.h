@@ -0,0 +1,71 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "capture.h"
+#include "sessionlog.h"
+
+/*parses "replay:FILE[@SPEED]"; speed 1 (default) keeps the recorded timing, 0 delivers the frames
+  as fast as they are read*/
+bool parseReplaySpec(std::string const& spec, std::string& path, double& speed);
+
+/*plays the first stream of a session log (see sessionlog.h) straight from its memory map, or a
+  video clip decoded into memory before the first frame, so no decoding happens while it plays;
+  the source ends after the last frame, every run sees the same frames in the same order*/
+class replay_source : public frame_source {
+public:
+  replay_source(std::string const& path, double speed);
+  bool isOpened() const { return frameCount() > 0; }
+  size_t frameCount() const { return is_log ? log_frames.size() : clip.size(); }
+  void read(cv::Mat& frame) override;
+  double frameRate() const override;
+
+private:
+  void preload(std::string const& path);
+  std::int64_t timestamp(size_t i) const;
+
+  double const speed;
+  bool is_log = false;
+  session_reader log;
+  std::vector<size_t> log_frames; //log index of every frame of the first stream
+  std::vector<cv::Mat> clip;
+  std::vector<std::int64_t> clip_timestamps; //microseconds
+
+  size_t next = 0;
+  std::chrono::steady_clock::time_point started;
+};
+
+/*the recorded side of a replayed session log: feeds the recorded input back in as the frames
+  come up, and compares the detections of this run with the recorded ones*/
+class session_replay {
+public:
+  struct counters {
+    unsigned long frames = 0;     //compared
+    unsigned long differing = 0;  //frames with a missing or extra box
+    unsigned long matched = 0, missing = 0, extra = 0; //boxes
+  };
+
+  bool open(std::string const& path);
+
+/*queues the input events recorded up to the capture of frame FRAME_ID of the replay*/
+  void replayInput(unsigned long frame_id);
+/*matches BOXES against the boxes recorded for frame FRAME_ID by class and overlap,
+  a line is written to REPORT for every frame that differs*/
+  void compare(unsigned long frame_id, std::vector<session_box> const& boxes, std::ostream* report);
+
+  counters stats() const { return totals; }
+
+private:
+  session_reader log;
+  std::vector<size_t> log_frames;
+  std::vector<session_input> inputs;
+  size_t next_input = 0;
+  counters totals;
+};
+
+#endif //REPLAY_H
@@ -0,0 +1,48 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef RING_H
+#define RING_H
+
+/*a fixed-size lock-free queue for exactly one producer thread and one consumer thread;
+  the indices only ever grow, so full and empty are told apart without a spare slot*/
+template <typename T, size_t N>
+class spsc_ring {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "the ring size must be a power of two");
+
+public:
+/*returns false and counts the item as dropped if the ring is full*/
+  bool push(T const& item) {
+    size_t const head = write_index.load(std::memory_order_relaxed);
+    if (head - read_index.load(std::memory_order_acquire) == N) {
+      dropped_count.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    items[head & (N - 1)] = item;
+    write_index.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& item) {
+    size_t const tail = read_index.load(std::memory_order_relaxed);
+    if (tail == write_index.load(std::memory_order_acquire)) { return false; }
+    item = items[tail & (N - 1)];
+    read_index.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const { return write_index.load(std::memory_order_acquire) - read_index.load(std::memory_order_acquire); }
+  unsigned long dropped() const { return dropped_count.load(std::memory_order_relaxed); }
+
+private:
+/*the indices live on separate cache lines so the two threads do not contend*/
+  alignas(64) std::atomic<size_t> write_index{0};
+  alignas(64) std::atomic<size_t> read_index{0};
+  alignas(64) std::atomic<unsigned long> dropped_count{0};
+  T items[N];
+};
+
+#endif //RING_H
@@ -0,0 +1,82 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "scheduler.h"
+
+/*weight of a new sample in the moving averages*/
+static const double SMOOTHING = 0.1;
+/*headroom added to the measured compositing time*/
+static const double MARGIN_US = 1000.0;
+
+bool parsePacingMode(std::string const& spec, pacing_mode& mode) {
+  if (spec == "latency") { mode = pacing_mode::latency; }
+  else if (spec == "smooth") { mode = pacing_mode::smooth; }
+  else { return false; }
+  return true;
+}
+
+frame_scheduler::frame_scheduler(pacing_mode mode, double refresh_rate)
+  : mode(mode),
+    refresh_period(std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / (refresh_rate > 0 ? refresh_rate : 60.0)))) {
+  composite_us = std::chrono::duration<double, std::micro>(refresh_period).count() / 4;
+}
+
+frame_scheduler::clock::time_point frame_scheduler::nextWake() {
+  auto const now = clock::now();
+  if (!has_vsync) {
+/*no swap has been seen yet, so the vsync phase is unknown; look for the first frame once a refresh
+  period instead of spinning while the source starts up*/
+    auto const wake = std::max(now, target_vsync);
+    target_vsync = wake + refresh_period;
+    return wake;
+  }
+
+  double const period_us = std::chrono::duration<double, std::micro>(refresh_period).count();
+  double const budget_us = std::min(std::max(composite_us + MARGIN_US, MARGIN_US), period_us - MARGIN_US / 2);
+  auto const budget = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::micro>(budget_us));
+
+/*in smooth mode every presented frame holds for the same number of vsyncs, unless the last slot had no frame*/
+  int const step = (mode == pacing_mode::smooth && !retry) ? frame_cadence : 1;
+  target_vsync = last_vsync + refresh_period * step;
+  while (target_vsync - budget < now) { target_vsync += refresh_period; }
+  return target_vsync - budget;
+}
+
+void frame_scheduler::frameArrived(clock::time_point captured) {
+  if (has_capture && captured > last_capture) {
+    double const interval_us = std::chrono::duration<double, std::micro>(captured - last_capture).count();
+/*ignore stalls and reordering, they say nothing about the source rate*/
+    if (interval_us > 1000.0 && interval_us < 1000000.0) {
+      source_period_us = source_period_us > 0 ? source_period_us + SMOOTHING * (interval_us - source_period_us) : interval_us;
+      double const period_us = std::chrono::duration<double, std::micro>(refresh_period).count();
+      frame_cadence = std::max(1, static_cast<int>(std::lround(source_period_us / period_us)));
+    }
+  }
+  last_capture = captured;
+  has_capture = true;
+}
+
+void frame_scheduler::presented(clock::time_point started, clock::time_point submitted, clock::time_point swapped) {
+  double const cost_us = std::chrono::duration<double, std::micro>(submitted - started).count();
+  composite_us += SMOOTHING * (cost_us - composite_us);
+
+/*the swap returns on the vsync that shows the frame, half a period late means the target was missed*/
+  if (has_vsync && swapped > target_vsync + refresh_period / 2) { deadlines_missed++; }
+  frames_presented++;
+
+  last_vsync = swapped;
+  has_vsync = true;
+  retry = false;
+}
+
+void frame_scheduler::skipped() {
+  retry = true;
+  if (has_vsync) {
+/*keep the vsync phase, the next wake aims at the vsync after the missed slot*/
+    last_vsync = target_vsync;
+  }
+}
@@ -0,0 +1,56 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+enum class pacing_mode {
+  latency, //composite the newest frame as late as possible before every vsync
+  smooth   //present source frames on an even cadence of vsyncs
+};
+
+/*parses "latency" or "smooth"*/
+bool parsePacingMode(std::string const& spec, pacing_mode& mode);
+
+/*paces the main loop on the display refresh, waking it just in time to composite before the swap*/
+class frame_scheduler {
+public:
+  typedef std::chrono::steady_clock clock;
+
+  frame_scheduler(pacing_mode mode, double refresh_rate);
+
+/*when to start compositing for the next vsync the loop should target*/
+  clock::time_point nextWake();
+/*notes the capture time of a new frame of the shown stream, to follow the source rate*/
+  void frameArrived(clock::time_point captured);
+/*call with the time compositing started, the time the swap was issued, and the time it returned*/
+  void presented(clock::time_point started, clock::time_point submitted, clock::time_point swapped);
+/*there was no new frame to composite at the wake time*/
+  void skipped();
+
+  double refreshRate() const { return 1.0 / std::chrono::duration<double>(refresh_period).count(); }
+/*vsyncs per source frame in smooth mode*/
+  int cadence() const { return frame_cadence; }
+  unsigned long presentedFrames() const { return frames_presented; }
+  unsigned long missedDeadlines() const { return deadlines_missed; }
+  double missRate() const { return frames_presented ? double(deadlines_missed) / frames_presented : 0.0; }
+
+private:
+  pacing_mode const mode;
+  clock::duration const refresh_period;
+
+  clock::time_point last_vsync, target_vsync, last_capture;
+  bool has_vsync = false, has_capture = false, retry = false;
+
+  double composite_us = 0.0; //moving average of the time from wake to swap
+  double source_period_us = 0.0; //moving average of the source frame interval
+  int frame_cadence = 1;
+
+  unsigned long frames_presented = 0;
+  unsigned long deadlines_missed = 0;
+};
+
+#endif //SCHEDULER_H
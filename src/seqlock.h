@@ -0,0 +1,58 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+/*publishes a small value from one writer thread to any number of readers: the writer never waits,
+  and readers only retry if they raced with a write; the value is kept in relaxed atomic words so a
+  torn read is detected by the sequence number instead of being a data race*/
+template <typename T>
+class seqlock {
+  static_assert(std::is_trivially_copyable<T>::value, "seqlock values are copied bytewise");
+
+public:
+  seqlock() { store(T()); }
+
+  seqlock(const seqlock&) = delete;
+  seqlock& operator=(const seqlock&) = delete;
+
+/*only one thread may store*/
+  void store(T const& value) {
+    std::uint64_t buffer[WORDS] = {};
+    std::memcpy(buffer, &value, sizeof(T));
+    unsigned long const seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed); //odd while the write is in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; i++) { words[i].store(buffer[i], std::memory_order_relaxed); }
+    sequence.store(seq + 2, std::memory_order_release);
+  }
+
+  T load() const {
+    std::uint64_t buffer[WORDS];
+    unsigned long before, after;
+    do {
+      before = sequence.load(std::memory_order_acquire);
+      for (size_t i = 0; i < WORDS; i++) { buffer[i] = words[i].load(std::memory_order_relaxed); }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = sequence.load(std::memory_order_relaxed);
+    } while (before != after || (before & 1));
+    T value;
+    std::memcpy(&value, buffer, sizeof(T));
+    return value;
+  }
+
+/*number of stores so far*/
+  unsigned long version() const { return sequence.load(std::memory_order_acquire) / 2; }
+
+private:
+  static const size_t WORDS = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+  std::atomic<unsigned long> sequence{0};
+  std::atomic<std::uint64_t> words[WORDS];
+};
+
+#endif //SEQLOCK_H
@@ -0,0 +1,332 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "sessionlog.h"
+#include "trace.h"
+
+static_assert(sizeof(session_file_header) == SESSION_ALIGNMENT, "the file header must keep records aligned");
+static_assert(sizeof(session_record) == SESSION_ALIGNMENT, "record headers must keep payloads aligned");
+static_assert(std::is_trivially_copyable<session_box>::value && sizeof(session_box) == 32, "session_box is part of the file format");
+static_assert(sizeof(session_input) == 48, "session_input is part of the file format");
+
+static size_t const PAGE_SIZE = 4096;
+
+static size_t padded(size_t bytes, size_t alignment = SESSION_ALIGNMENT) {
+  return (bytes + alignment - 1) / alignment * alignment;
+}
+
+session_writer::session_writer(std::string const& path, int buffer_count, size_t buffer_size)
+  : path(path), buffer_count(std::max(buffer_count, 2)), buffer_size(buffer_size) {}
+
+session_writer::~session_writer() {
+  close();
+}
+
+bool session_writer::open(size_t frame_bytes) {
+  fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) { return false; }
+  opened = clock::now();
+
+/*every buffer holds at least two frames, and whole pages so the writes stay aligned*/
+  buffer_size = padded(std::max(buffer_size, 2 * (sizeof(session_record) + padded(frame_bytes))), PAGE_SIZE);
+  free_buffers.set_capacity(buffer_count);
+  full_buffers.set_capacity(buffer_count + 1); //every buffer and the end marker
+  for (int i = 0; i < buffer_count; i++) {
+    void* data = NULL;
+    if (posix_memalign(&data, PAGE_SIZE, buffer_size) != 0) { throw std::bad_alloc(); }
+    buffers.push_back(buffer{static_cast<char*>(data), 0});
+  }
+  for (auto& b : buffers) { free_buffers.push(&b); }
+
+  free_buffers.pop(current);
+  session_file_header header = {};
+  std::memcpy(header.magic, SESSION_MAGIC, 4);
+  header.version = SESSION_VERSION;
+  header.created = static_cast<std::int64_t>(std::time(NULL));
+  std::memcpy(current->data, &header, sizeof(header));
+  current->used = sizeof(header);
+  file_size = sizeof(header);
+
+  thread = std::thread(&session_writer::run, this);
+  return true;
+}
+
+void session_writer::close() {
+  if (fd < 0) { return; }
+  if (current) {
+    full_buffers.push(current);
+    current = NULL;
+  }
+  full_buffers.push(NULL);
+  if (thread.joinable()) { thread.join(); }
+
+  session_footer footer = {};
+  footer.index_offset = file_size;
+  footer.index_count = index.size();
+  std::memcpy(footer.magic, SESSION_INDEX_MAGIC, 4);
+  footer.version = SESSION_VERSION;
+  if (!writeAll(reinterpret_cast<char const*>(index.data()), index.size() * sizeof(session_index_entry)) ||
+      !writeAll(reinterpret_cast<char const*>(&footer), sizeof(footer))) {
+    write_failed = true;
+  }
+  ::close(fd);
+  fd = -1;
+
+  for (auto& b : buffers) { std::free(b.data); }
+  buffers.clear();
+  free_buffers.clear();
+  full_buffers.clear();
+}
+
+std::int64_t session_writer::sinceOpen(clock::time_point t) const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(t - opened).count();
+}
+
+session_record* session_writer::reserve(std::uint32_t kind, int stream, size_t payload, std::uint64_t& offset) {
+  size_t const bytes = sizeof(session_record) + padded(payload);
+  if (fd < 0 || write_failed || bytes > buffer_size) {
+    records_dropped++;
+    return NULL;
+  }
+  if (current && current->used + bytes > buffer_size) {
+    full_buffers.push(current);
+    current = NULL;
+  }
+/*the writer thread has not caught up, the record is lost but the main loop does not wait*/
+  if (!current && !free_buffers.try_pop(current)) {
+    current = NULL;
+    records_dropped++;
+    return NULL;
+  }
+
+  char* const start = current->data + current->used;
+  std::memset(start + sizeof(session_record) + payload, 0, bytes - sizeof(session_record) - payload);
+  session_record* const record = reinterpret_cast<session_record*>(start);
+  *record = session_record();
+  record->kind = kind;
+  record->stream = static_cast<std::uint32_t>(stream);
+  record->size = payload;
+
+  offset = file_size;
+  current->used += bytes;
+  file_size += bytes;
+  return record;
+}
+
+bool session_writer::addFrame(int stream, unsigned long frame_id, clock::time_point captured, cv::Mat const& frame) {
+  TRACE_SCOPE("session log");
+  size_t const row_bytes = frame.cols * frame.elemSize();
+  std::uint64_t offset;
+  session_record* const record = reserve(SESSION_FRAME, stream, row_bytes * frame.rows, offset);
+  if (!record) { return false; }
+  record->frame_id = frame_id;
+  record->timestamp_us = sinceOpen(captured);
+  record->width = frame.cols;
+  record->height = frame.rows;
+  record->type = frame.type();
+
+  char* pixels = reinterpret_cast<char*>(record + 1);
+  if (frame.isContinuous()) { std::memcpy(pixels, frame.data, row_bytes * frame.rows); }
+  else {
+    for (int y = 0; y < frame.rows; y++) { std::memcpy(pixels + y * row_bytes, frame.ptr(y), row_bytes); }
+  }
+
+  index.push_back(session_index_entry{offset, 0, frame_id, record->timestamp_us, record->stream, 0});
+  frames_logged++;
+  return true;
+}
+
+bool session_writer::addBoxes(int stream, unsigned long frame_id, clock::time_point captured, std::vector<session_box> const& boxes) {
+  std::uint64_t offset;
+  session_record* const record = reserve(SESSION_BOXES, stream, boxes.size() * sizeof(session_box), offset);
+  if (!record) { return false; }
+  record->frame_id = frame_id;
+  record->timestamp_us = sinceOpen(captured);
+  if (!boxes.empty()) { std::memcpy(record + 1, boxes.data(), boxes.size() * sizeof(session_box)); }
+
+/*the boxes follow their frame closely, only the last few index entries need to be looked at*/
+  for (size_t i = index.size(), checked = 0; i > 0 && checked < 16; i--, checked++) {
+    session_index_entry& entry = index[i - 1];
+    if (entry.stream == record->stream && entry.frame_id == frame_id) {
+      entry.boxes_offset = offset;
+      break;
+    }
+  }
+  return true;
+}
+
+bool session_writer::addInput(std::vector<control_event> const& events) {
+  if (events.empty()) { return true; }
+  std::uint64_t offset;
+  session_record* const record = reserve(SESSION_INPUT, 0, events.size() * sizeof(session_input), offset);
+  if (!record) { return false; }
+  record->timestamp_us = sinceOpen(events.front().timestamp);
+
+  session_input* inputs = reinterpret_cast<session_input*>(record + 1);
+  for (auto const& e : events) {
+    session_input input = {};
+    input.type = static_cast<std::uint32_t>(e.type);
+    input.code = e.code;
+    input.scancode = e.scancode;
+    input.action = e.action;
+    input.modifiers = e.modifiers;
+    input.xpos = e.xpos;
+    input.ypos = e.ypos;
+    input.timestamp_us = sinceOpen(e.timestamp);
+    *inputs++ = input;
+  }
+  return true;
+}
+
+bool session_writer::writeAll(char const* data, size_t size) {
+  while (size > 0) {
+    ssize_t const written = ::write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+void session_writer::run() {
+  traceThreadName("session log");
+  for (;;) {
+    buffer* b;
+    full_buffers.pop(b);
+    if (!b) { break; }
+    {
+      TRACE_SCOPE("write");
+      if (!write_failed && !writeAll(b->data, b->used)) { write_failed = true; }
+    }
+    b->used = 0;
+    free_buffers.push(b);
+  }
+}
+
+session_reader::~session_reader() {
+  close();
+}
+
+bool session_reader::open(std::string const& path) {
+  close();
+  int const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) { return false; }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(session_file_header))) {
+    ::close(fd);
+    return false;
+  }
+  void* const map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); //the mapping keeps the file open
+  if (map == MAP_FAILED) { return false; }
+  data = static_cast<char const*>(map);
+  size = static_cast<size_t>(st.st_size);
+
+  session_file_header header;
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, SESSION_MAGIC, 4) != 0 || header.version != SESSION_VERSION) {
+    close();
+    return false;
+  }
+
+  session_footer footer = {};
+  if (size >= sizeof(header) + sizeof(footer)) { std::memcpy(&footer, data + size - sizeof(footer), sizeof(footer)); }
+/*the index must fit between its offset and the footer, checked before anything is multiplied*/
+  bool const indexed = std::memcmp(footer.magic, SESSION_INDEX_MAGIC, 4) == 0 &&
+                       footer.index_offset >= sizeof(header) &&
+                       footer.index_offset <= size - sizeof(footer) &&
+                       footer.index_count <= (size - sizeof(footer) - footer.index_offset) / sizeof(session_index_entry) &&
+                       footer.index_offset + footer.index_count * sizeof(session_index_entry) + sizeof(footer) == size;
+  if (indexed) {
+    records_end = footer.index_offset;
+    index.resize(footer.index_count);
+    if (!index.empty()) { std::memcpy(index.data(), data + footer.index_offset, index.size() * sizeof(session_index_entry)); }
+  } else {
+    rebuildIndex();
+  }
+  return true;
+}
+
+void session_reader::close() {
+  if (data) { munmap(const_cast<char*>(data), size); }
+  data = NULL;
+  size = 0;
+  records_end = 0;
+  index.clear();
+}
+
+session_record const* session_reader::record(std::uint64_t offset) const {
+  if (offset < sizeof(session_file_header) || offset + sizeof(session_record) > records_end) { return NULL; }
+  session_record const* const r = reinterpret_cast<session_record const*>(data + offset);
+  if (r->size > records_end - offset - sizeof(session_record)) { return NULL; }
+  return r;
+}
+
+void session_reader::rebuildIndex() {
+/*walk the record headers up to the first one that is incomplete or not a record at all*/
+  records_end = size;
+  std::uint64_t offset = sizeof(session_file_header);
+  while (session_record const* r = record(offset)) {
+    if (r->kind != SESSION_FRAME && r->kind != SESSION_BOXES && r->kind != SESSION_INPUT) { break; }
+    std::uint64_t const next = offset + sizeof(session_record) + padded(r->size);
+    if (next > size) { break; }
+    if (r->kind == SESSION_FRAME) {
+      index.push_back(session_index_entry{offset, 0, r->frame_id, r->timestamp_us, r->stream, 0});
+    } else if (r->kind == SESSION_BOXES) {
+      for (size_t i = index.size(); i > 0; i--) {
+        if (index[i - 1].stream == r->stream && index[i - 1].frame_id == r->frame_id) {
+          index[i - 1].boxes_offset = offset;
+          break;
+        }
+      }
+    }
+    offset = next;
+  }
+  records_end = offset;
+}
+
+bool session_reader::frame(size_t i, session_frame& out) const {
+  if (i >= index.size()) { return false; }
+  session_index_entry const& entry = index[i];
+  session_record const* const r = record(entry.frame_offset);
+  if (!r || r->kind != SESSION_FRAME) { return false; }
+/*the geometry comes from the file, cv::Mat throws on what a corrupted header may hold*/
+  if (r->width <= 0 || r->height <= 0 || (r->type != CV_8UC3 && r->type != CV_8UC1)) { return false; }
+  if (static_cast<std::uint64_t>(r->width) * static_cast<std::uint64_t>(r->height) * CV_ELEM_SIZE(r->type) != r->size) { return false; }
+  cv::Mat const image(r->height, r->width, r->type, const_cast<session_record*>(r + 1));
+
+  out.stream = static_cast<int>(r->stream);
+  out.frame_id = static_cast<unsigned long>(r->frame_id);
+  out.timestamp_us = r->timestamp_us;
+  out.image = image;
+  out.boxes = NULL;
+  out.box_count = 0;
+  if (entry.boxes_offset) {
+    session_record const* const boxes = record(entry.boxes_offset);
+    if (boxes && boxes->kind == SESSION_BOXES) {
+      out.boxes = reinterpret_cast<session_box const*>(boxes + 1);
+      out.box_count = boxes->size / sizeof(session_box);
+    }
+  }
+  return true;
+}
+
+std::vector<session_input> session_reader::inputs() const {
+  std::vector<session_input> events;
+  std::uint64_t offset = sizeof(session_file_header);
+  while (session_record const* r = record(offset)) {
+    if (r->kind == SESSION_INPUT) {
+      session_input const* const first = reinterpret_cast<session_input const*>(r + 1);
+      events.insert(events.end(), first, first + r->size / sizeof(session_input));
+    }
+    offset += sizeof(session_record) + padded(r->size);
+  }
+  return events;
+}
@@ -0,0 +1,173 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef SESSIONLOG_H
+#define SESSIONLOG_H
+
+/*A session log is an append-only file of raw frames, detections and input events:
+
+    file header | record | record | ... | frame index | footer
+
+  Every record is a 64-byte header followed by its payload, padded to 64 bytes so frames can be
+  used in place from a memory map. The index at the end lists every frame record (and the boxes
+  found in it) for constant time seeks; a log cut short by a crash has no index, the reader then
+  rebuilds it from the record headers.*/
+
+#define SESSION_MAGIC "CSES"
+#define SESSION_INDEX_MAGIC "CIDX"
+#define SESSION_VERSION 1
+#define SESSION_ALIGNMENT 64
+
+enum session_record_kind : std::uint32_t {
+  SESSION_FRAME = 1, //raw pixels, width * height * element size bytes
+  SESSION_BOXES = 2, //session_box array for the frame with the same stream and frame id
+  SESSION_INPUT = 3  //session_input array
+};
+
+struct session_file_header {
+  char magic[4];
+  std::uint32_t version;
+  std::int64_t created; //seconds since the Unix epoch
+  std::uint8_t reserved[48];
+};
+
+struct session_record {
+  std::uint32_t kind;
+  std::uint32_t stream;
+  std::uint64_t size; //payload bytes, without the padding
+  std::uint64_t frame_id;
+  std::int64_t timestamp_us; //capture or event time, since the log was opened
+  std::int32_t width, height, type; //frames only, type is the OpenCV matrix type
+  std::uint8_t reserved[20];
+};
+
+/*a detection, like darknet's bbox_t but with a fixed layout*/
+struct session_box {
+  std::uint32_t x, y, w, h;
+  float prob;
+  std::uint32_t obj_id, track_id, frames_counter;
+};
+
+struct session_input {
+  std::uint32_t type; //control_event::event_type
+  std::int32_t code, scancode, action, modifiers;
+  std::uint32_t reserved;
+  double xpos, ypos;
+  std::int64_t timestamp_us;
+};
+
+struct session_index_entry {
+  std::uint64_t frame_offset;
+  std::uint64_t boxes_offset; //0 if the frame has no boxes
+  std::uint64_t frame_id;
+  std::int64_t timestamp_us;
+  std::uint32_t stream;
+  std::uint32_t reserved;
+};
+
+struct session_footer {
+  std::uint64_t index_offset;
+  std::uint64_t index_count;
+  char magic[4];
+  std::uint32_t version;
+};
+
+/*writes a session log from the main loop without blocking it: records are appended to large
+  page-aligned buffers and a writer thread hands full buffers to the kernel in one write each.
+  When every buffer is waiting to be written the record is dropped and counted*/
+class session_writer {
+public:
+  typedef std::chrono::steady_clock clock;
+
+  explicit session_writer(std::string const& path, int buffer_count = 4, size_t buffer_size = 16 << 20);
+  ~session_writer();
+
+  session_writer(const session_writer&) = delete;
+  session_writer& operator=(const session_writer&) = delete;
+
+/*FRAME_BYTES is the size of the largest frame that will be logged*/
+  bool open(size_t frame_bytes);
+/*writes what is buffered, the index and the footer*/
+  void close();
+  bool isOpen() const { return fd >= 0; }
+
+  bool addFrame(int stream, unsigned long frame_id, clock::time_point captured, cv::Mat const& frame);
+  bool addBoxes(int stream, unsigned long frame_id, clock::time_point captured, std::vector<session_box> const& boxes);
+  bool addInput(std::vector<control_event> const& events);
+
+  unsigned long frames() const { return frames_logged; }
+  unsigned long dropped() const { return records_dropped; }
+  std::uint64_t bytes() const { return file_size; }
+
+private:
+  struct buffer {
+    char* data;
+    size_t used;
+  };
+
+  std::int64_t sinceOpen(clock::time_point t) const;
+/*room for a record with the given payload at OFFSET in the file, NULL if it has to be dropped*/
+  session_record* reserve(std::uint32_t kind, int stream, size_t payload, std::uint64_t& offset);
+  void run();
+  bool writeAll(char const* data, size_t size);
+
+  std::string const path;
+  int const buffer_count;
+  size_t buffer_size;
+  int fd = -1;
+  clock::time_point opened;
+
+  std::vector<buffer> buffers;
+  tbb::concurrent_bounded_queue<buffer*> free_buffers, full_buffers;
+  buffer* current = NULL;
+  std::thread thread;
+  std::atomic<bool> write_failed{false};
+
+  std::uint64_t file_size = 0; //bytes appended so far, written or still buffered
+  std::vector<session_index_entry> index;
+  unsigned long frames_logged = 0;
+  unsigned long records_dropped = 0;
+};
+
+/*one frame of a session log, the pixels point into the memory map*/
+struct session_frame {
+  int stream = 0;
+  unsigned long frame_id = 0;
+  std::int64_t timestamp_us = 0;
+  cv::Mat image;
+  session_box const* boxes = NULL;
+  size_t box_count = 0;
+};
+
+/*reads a session log through a read-only memory map*/
+class session_reader {
+public:
+  session_reader() {}
+  ~session_reader();
+
+  session_reader(const session_reader&) = delete;
+  session_reader& operator=(const session_reader&) = delete;
+
+  bool open(std::string const& path);
+  void close();
+
+  size_t frameCount() const { return index.size(); }
+  session_index_entry const& entry(size_t i) const { return index[i]; }
+  bool frame(size_t i, session_frame& out) const;
+/*every input event in the log, in the order they were handled*/
+  std::vector<session_input> inputs() const;
+
+private:
+  session_record const* record(std::uint64_t offset) const;
+  void rebuildIndex();
+
+  char const* data = NULL;
+  size_t size = 0;
+  std::uint64_t records_end = 0; //where the index starts
+  std::vector<session_index_entry> index;
+};
+
+#endif //SESSIONLOG_H
@@ -0,0 +1,138 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "synth.h"
+
+/*how far the noise pattern can wander, it is generated once and a shifted window is copied per frame*/
+static const int NOISE_MARGIN = 64;
+static const int SHAPE_COUNT = 6;
+
+bool parseSynthSpec(std::string const& spec, synth_options& options) {
+  if (spec.compare(0, 5, "synth") != 0) { return false; }
+  if (spec.size() == 5) { return true; }
+  if (spec[5] != ':') { return false; }
+
+  std::vector<std::string> fields;
+  for (std::stringstream list(spec.substr(6)); list.good();) {
+    std::string field;
+    std::getline(list, field, ':');
+    fields.push_back(field);
+  }
+
+  if (!fields[0].empty()) {
+    int width = 0, height = 0;
+    double fps = options.fps;
+    char separator = 0;
+    std::stringstream geometry(fields[0]);
+    geometry >> width >> separator >> height;
+    if (!geometry || separator != 'x' || width <= 0 || height <= 0) { return false; }
+    if (geometry.peek() == '@') {
+      geometry.get();
+      geometry >> fps;
+      if (!geometry || fps < 0) { return false; }
+    }
+    if (!geometry.eof() && geometry.peek() != EOF) { return false; }
+    options.size = cv::Size(width, height);
+    options.fps = fps;
+  }
+  if (fields.size() > 1) {
+    if (fields[1] == "shapes") { options.content = synth_content::shapes; }
+    else if (fields[1] == "noise") { options.content = synth_content::noise; }
+    else if (fields[1] == "static") { options.content = synth_content::still; }
+    else { return false; }
+  }
+  if (fields.size() > 2) {
+    char* end = NULL;
+    options.seed = static_cast<unsigned int>(std::strtoul(fields[2].c_str(), &end, 10));
+    if (fields[2].empty() || *end != '\0') { return false; }
+  }
+  return fields.size() <= 3;
+}
+
+/*bounces x back and forth between 0 and range*/
+static float reflect(float x, float range) {
+  if (range <= 0) { return 0; }
+  float const period = 2 * range;
+  float t = std::fmod(x, period);
+  if (t < 0) { t += period; }
+  return t <= range ? t : period - t;
+}
+
+synth_source::synth_source(synth_options const& options) : options(options) {
+  int const width = options.size.width, height = options.size.height;
+  cv::RNG rng(options.seed);
+
+  background.create(options.size, CV_8UC3);
+  for (int y = 0; y < height; y++) {
+    background.row(y).setTo(cv::Scalar(40 + 80*y/height, 60, 100 - 60*y/height));
+  }
+
+  float const speed = width / 160.0f; //about four pixels per frame at 640 pixels
+  for (int i = 0; i < SHAPE_COUNT; i++) {
+    shape s;
+    s.size = cv::Size(rng.uniform(width/12, width/5 + 1), rng.uniform(height/12, height/5 + 1));
+    s.origin = cv::Point2f(rng.uniform(0.0f, static_cast<float>(width)), rng.uniform(0.0f, static_cast<float>(height)));
+    s.velocity = cv::Point2f(rng.uniform(-speed, speed), rng.uniform(-speed, speed));
+    s.color = cv::Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+    s.round = (i % 2) == 1;
+    shapes.push_back(s);
+  }
+
+  if (options.content == synth_content::noise) {
+    noise.create(height + NOISE_MARGIN, width + NOISE_MARGIN, CV_8UC3);
+    rng.fill(noise, cv::RNG::UNIFORM, 0, 256);
+  } else if (options.content == synth_content::still) {
+/*the static scene is the first frame of the shapes, drawn once*/
+    drawShapes(background, 0);
+  }
+
+  next_frame = std::chrono::steady_clock::now();
+}
+
+void synth_source::drawShapes(cv::Mat& frame, unsigned long n) {
+  boxes.clear();
+  for (auto const& s : shapes) {
+    float const x = reflect(s.origin.x + s.velocity.x * n, static_cast<float>(frame.cols - s.size.width));
+    float const y = reflect(s.origin.y + s.velocity.y * n, static_cast<float>(frame.rows - s.size.height));
+    cv::Rect const box(cvRound(x), cvRound(y), s.size.width, s.size.height);
+    if (s.round) {
+      cv::ellipse(frame, cv::Point(box.x + box.width/2, box.y + box.height/2), cv::Size(box.width/2, box.height/2),
+                  0, 0, 360, s.color, -1, cv::LINE_8);
+    } else {
+      cv::rectangle(frame, box, s.color, -1, cv::LINE_8);
+    }
+    boxes.push_back(box);
+  }
+}
+
+void synth_source::read(cv::Mat& frame) {
+/*keep to the requested rate like a camera would; falling behind does not make later frames come faster*/
+  if (options.fps > 0) {
+    std::this_thread::sleep_until(next_frame);
+    auto const now = std::chrono::steady_clock::now();
+    next_frame = std::max(next_frame, now - std::chrono::milliseconds(100))
+               + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / options.fps));
+  }
+
+  unsigned long const n = frame_number++;
+  frame.create(options.size, CV_8UC3);
+  switch (options.content) {
+    case synth_content::shapes:
+      background.copyTo(frame);
+      drawShapes(frame, n);
+      cv::putText(frame, std::to_string(n), cv::Point(10, frame.rows - 10), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(255,255,255), 2);
+      break;
+    case synth_content::noise: {
+      int const dx = static_cast<int>((n * 7) % NOISE_MARGIN), dy = static_cast<int>((n * 13) % NOISE_MARGIN);
+      noise(cv::Rect(dx, dy, options.size.width, options.size.height)).copyTo(frame);
+      break;
+    }
+    case synth_content::still:
+      background.copyTo(frame);
+      break;
+  }
+}
@@ -0,0 +1,57 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include "capture.h"
+
+enum class synth_content {
+  shapes, //shapes moving over a gradient, their boxes are known
+  noise,  //high-frequency noise, the worst case for the edge filter
+  still   //one unchanging scene
+};
+
+struct synth_options {
+  cv::Size size{1280, 720};
+  double fps = 30; //0 generates frames as fast as they are read
+  synth_content content = synth_content::shapes;
+  unsigned int seed = 1;
+};
+
+/*parses "synth[:WxH[@FPS][:CONTENT[:SEED]]]", e.g. "synth:1920x1080@60:noise:7"*/
+bool parseSynthSpec(std::string const& spec, synth_options& options);
+
+/*generates frames without a camera or video file; frame n depends only on the options and n,
+  so every run with the same spec sees the same content*/
+class synth_source : public frame_source {
+public:
+  explicit synth_source(synth_options const& options);
+  void read(cv::Mat& frame) override;
+  double frameRate() const override { return options.fps; }
+
+/*where the shapes of the most recent frame are*/
+  std::vector<cv::Rect> const& objects() const { return boxes; }
+
+private:
+  struct shape {
+    cv::Size size;
+    cv::Point2f origin, velocity; //pixels and pixels per frame
+    cv::Scalar color;
+    bool round;
+  };
+
+  void drawShapes(cv::Mat& frame, unsigned long n);
+
+  synth_options const options;
+  std::vector<shape> shapes;
+  std::vector<cv::Rect> boxes;
+  cv::Mat background, noise;
+  unsigned long frame_number = 0;
+  std::chrono::steady_clock::time_point next_frame;
+};
+
+#endif //SYNTH_H
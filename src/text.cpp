@@ -0,0 +1,274 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "rendering.h"
+#include "text.h"
+
+#include <unordered_map>
+
+extern Globals global;
+
+static const int font_face = cv::FONT_HERSHEY_COMPLEX_SMALL;
+static const double atlas_scale = 1.2; //the size labels are drawn at, other sizes are scaled from it
+static const int atlas_thickness = 2;
+static const int atlas_width = 512;
+static const int glyph_padding = 2;
+static const char first_glyph = 32, last_glyph = 126;
+static const size_t max_sprites = 256;
+
+struct glyph {
+  int advance; //pen movement in atlas pixels
+  float u0, v0, u1, v1;
+};
+
+/*the cached geometry of one string: a quad per glyph, drawn with a single call*/
+struct text_sprite {
+  GLuint vao = 0, vbo = 0;
+  GLsizei vertices = 0;
+  unsigned long last_used = 0;
+};
+
+static struct {
+  bool initialized = false;
+  GLuint program = 0, atlas = 0;
+  GLint projection, origin, scale, text_scale, frame_height, flip, flip_shift, color, atlas_sampler;
+  glyph glyphs[last_glyph - first_glyph + 1];
+  int ascent = 0, cell_height = 0;
+  std::unordered_map<std::string, text_sprite> sprites;
+  unsigned long frame = 0;
+  std::vector<std::pair<text_item, text_sprite const*>> items;
+  int frame_w = 1, frame_h = 1;
+} text;
+
+static const char* const text_vertex_shader = R"(
+#version 330 core
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 texcoord;
+uniform mat4 projection;
+uniform vec2 origin;
+uniform vec2 scale;
+uniform float text_scale;
+uniform float frame_height;
+uniform bool flip;
+uniform float flip_shift;
+out vec2 uv;
+void main() {
+  vec2 anchor = origin;
+/*mirror the whole line, not just its baseline, so it stays on its mirrored box; the glyphs stay upright*/
+  if (flip) { anchor.y = frame_height - anchor.y - flip_shift * text_scale; }
+  uv = texcoord;
+  gl_Position = projection * vec4((anchor + position * text_scale) * scale, 0.0, 1.0);
+}
+)";
+
+static const char* const text_fragment_shader = R"(
+#version 330 core
+in vec2 uv;
+uniform sampler2D atlas;
+uniform vec3 color;
+out vec4 frag_color;
+void main() {
+  frag_color = vec4(color, texture(atlas, uv).r);
+}
+)";
+
+static glyph const* findGlyph(char c) {
+  if (c < first_glyph || c > last_glyph) { c = '?'; }
+  return &text.glyphs[c - first_glyph];
+}
+
+bool initText() {
+  text.program = linkProgram(text_vertex_shader, text_fragment_shader);
+  if (!text.program) { return false; }
+  text.projection = glGetUniformLocation(text.program, "projection");
+  text.origin = glGetUniformLocation(text.program, "origin");
+  text.scale = glGetUniformLocation(text.program, "scale");
+  text.text_scale = glGetUniformLocation(text.program, "text_scale");
+  text.frame_height = glGetUniformLocation(text.program, "frame_height");
+  text.flip = glGetUniformLocation(text.program, "flip");
+  text.flip_shift = glGetUniformLocation(text.program, "flip_shift");
+  text.color = glGetUniformLocation(text.program, "color");
+  text.atlas_sampler = glGetUniformLocation(text.program, "atlas");
+
+/*measure every glyph; the advance is what a second copy of the glyph adds to the string width*/
+  int descent = 0;
+  int widths[last_glyph - first_glyph + 1];
+  for (char c = first_glyph; c <= last_glyph; c++) {
+    int baseline = 0;
+    cv::Size const single = cv::getTextSize(std::string(1, c), font_face, atlas_scale, atlas_thickness, &baseline);
+    cv::Size const twice = cv::getTextSize(std::string(2, c), font_face, atlas_scale, atlas_thickness, NULL);
+    text.glyphs[c - first_glyph].advance = twice.width - single.width;
+    widths[c - first_glyph] = single.width;
+    text.ascent = std::max(text.ascent, single.height);
+    descent = std::max(descent, baseline);
+  }
+  text.cell_height = text.ascent + descent + atlas_thickness + 2 * glyph_padding;
+
+/*lay the glyphs out in rows and rasterize them once*/
+  int x = 0, y = 0;
+  std::vector<cv::Point> positions;
+  for (char c = first_glyph; c <= last_glyph; c++) {
+    int const cell_width = widths[c - first_glyph] + 2 * glyph_padding;
+    if (x + cell_width > atlas_width) { x = 0; y += text.cell_height; }
+    positions.emplace_back(x, y);
+    x += cell_width;
+  }
+  int const atlas_height = y + text.cell_height;
+
+  cv::Mat atlas = cv::Mat::zeros(atlas_height, atlas_width, CV_8UC1);
+  for (char c = first_glyph; c <= last_glyph; c++) {
+    cv::Point const& cell = positions[c - first_glyph];
+    int const cell_width = widths[c - first_glyph] + 2 * glyph_padding;
+    cv::putText(atlas, std::string(1, c), cv::Point(cell.x + glyph_padding, cell.y + glyph_padding + text.ascent),
+                font_face, atlas_scale, cv::Scalar(255), atlas_thickness, cv::LINE_AA);
+    glyph& g = text.glyphs[c - first_glyph];
+    g.u0 = static_cast<float>(cell.x) / atlas_width;
+    g.v0 = static_cast<float>(cell.y) / atlas_height;
+    g.u1 = static_cast<float>(cell.x + cell_width) / atlas_width;
+    g.v1 = static_cast<float>(cell.y + text.cell_height) / atlas_height;
+  }
+
+  glGenTextures(1, &text.atlas);
+  glBindTexture(GL_TEXTURE_2D, text.atlas);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlas_width, atlas_height, 0, GL_RED, GL_UNSIGNED_BYTE, atlas.data);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  text.initialized = true;
+  return true;
+}
+
+static void destroySprite(text_sprite& sprite) {
+  glDeleteVertexArrays(1, &sprite.vao);
+  glDeleteBuffers(1, &sprite.vbo);
+}
+
+void destroyText() {
+  for (auto& i : text.sprites) { destroySprite(i.second); }
+  text.sprites.clear();
+  text.items.clear();
+  glDeleteTextures(1, &text.atlas);
+  glDeleteProgram(text.program);
+  text.atlas = text.program = 0;
+  text.initialized = false;
+}
+
+int measureText(std::string const& str, double scale) {
+  if (!text.initialized) { return cv::getTextSize(str, font_face, scale, atlas_thickness, NULL).width; }
+  int width = atlas_thickness;
+  for (char c : str) { width += findGlyph(c)->advance; }
+  return static_cast<int>(width * scale / atlas_scale + 0.5);
+}
+
+static text_sprite buildSprite(std::string const& str) {
+  std::vector<GLfloat> vertices;
+  vertices.reserve(str.size() * 24);
+  float pen = -glyph_padding;
+  float const top = -(text.ascent + glyph_padding), bottom = top + text.cell_height;
+  for (char c : str) {
+    glyph const* g = findGlyph(c);
+    float const right = pen + (g->u1 - g->u0) * atlas_width;
+    GLfloat const quad[24] = {
+      pen,   top,    g->u0, g->v0,
+      right, top,    g->u1, g->v0,
+      pen,   bottom, g->u0, g->v1,
+      right, top,    g->u1, g->v0,
+      right, bottom, g->u1, g->v1,
+      pen,   bottom, g->u0, g->v1,
+    };
+    vertices.insert(vertices.end(), quad, quad + 24);
+    pen += g->advance;
+  }
+
+  text_sprite sprite;
+  sprite.vertices = static_cast<GLsizei>(vertices.size() / 4);
+  glGenVertexArrays(1, &sprite.vao);
+  glBindVertexArray(sprite.vao);
+  glGenBuffers(1, &sprite.vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, sprite.vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), NULL);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), reinterpret_cast<void*>(2 * sizeof(GLfloat)));
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return sprite;
+}
+
+static text_sprite const* findSprite(std::string const& str) {
+  auto found = text.sprites.find(str);
+  if (found == text.sprites.end()) {
+/*evict the least recently used sprite, e.g. clock readings from a while ago,
+  but never one that is already part of this frame*/
+    if (text.sprites.size() >= max_sprites) {
+      auto oldest = text.sprites.begin();
+      for (auto i = text.sprites.begin(); i != text.sprites.end(); ++i) {
+        if (i->second.last_used < oldest->second.last_used) { oldest = i; }
+      }
+      if (oldest->second.last_used != text.frame) {
+        destroySprite(oldest->second);
+        text.sprites.erase(oldest);
+      }
+    }
+    found = text.sprites.emplace(str, buildSprite(str)).first;
+  }
+  found->second.last_used = text.frame;
+  return &found->second;
+}
+
+void setText(std::vector<text_item> const& items, int frame_w, int frame_h) {
+  text.frame++;
+  text.frame_w = frame_w;
+  text.frame_h = frame_h;
+  text.items.clear();
+  if (!text.initialized) { return; }
+  for (auto& i : items) {
+    if (!i.text.empty()) { text.items.emplace_back(i, findSprite(i.text)); }
+  }
+}
+
+void drawText(int window_w, int window_h) {
+  if (text.items.empty()) { return; }
+
+  glUseProgram(text.program);
+  glUniformMatrix4fv(text.projection, 1, GL_FALSE, hudProjection());
+  glUniform2f(text.scale, static_cast<float>(window_w) / text.frame_w, static_cast<float>(window_h) / text.frame_h);
+  glUniform1f(text.frame_height, static_cast<float>(text.frame_h));
+  glUniform1i(text.flip, global.flags.flip_image);
+/*the glyph quads span [top, top + cell_height] around the baseline, see buildSprite()*/
+  float const top = -(text.ascent + glyph_padding);
+  glUniform1f(text.flip_shift, 2 * top + text.cell_height);
+  glUniform1i(text.atlas_sampler, 0);
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, text.atlas);
+  for (auto& i : text.items) {
+    text_item const& item = i.first;
+    glUniform2f(text.origin, item.x, item.y);
+    glUniform1f(text.text_scale, static_cast<float>(item.scale / atlas_scale));
+    glUniform3f(text.color, item.r, item.g, item.b);
+    glBindVertexArray(i.second->vao);
+    glDrawArrays(GL_TRIANGLES, 0, i.second->vertices);
+  }
+  glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDisable(GL_BLEND);
+}
+
+void burnText(cv::Mat& frame, std::vector<text_item> const& items) {
+  for (auto& i : items) {
+    cv::putText(frame, i.text, cv::Point(static_cast<int>(i.x), static_cast<int>(i.y)), font_face, i.scale,
+                cv::Scalar(i.b * 255, i.g * 255, i.r * 255), atlas_thickness);
+  }
+}
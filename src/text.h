@@ -0,0 +1,32 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef TEXT_H
+#define TEXT_H
+
+/*a string to draw over the video, in video frame pixel coordinates*/
+struct text_item {
+  std::string text;
+  float x, y; //left end of the baseline, like cv::putText()
+  float scale; //relative to cv::FONT_HERSHEY_COMPLEX_SMALL at scale 1
+  float r, g, b;
+};
+
+/*builds the glyph atlas, call after initRenderer()*/
+bool initText();
+void destroyText();
+
+/*width of the string in pixels, computed from the cached glyph metrics*/
+int measureText(std::string const& text, double scale);
+
+/*looks up or builds the cached sprite of every string, once per frame*/
+void setText(std::vector<text_item> const& items, int frame_w, int frame_h);
+void drawText(int window_w, int window_h);
+
+/*rasterizes the strings into the frame, for recordings*/
+void burnText(cv::Mat& frame, std::vector<text_item> const& items);
+
+#endif //TEXT_H
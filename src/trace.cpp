@@ -0,0 +1,175 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "trace.h"
+
+
+/*events kept per thread, older ones are overwritten*/
+static const size_t RING_SIZE = 1 << 16;
+
+namespace {
+
+struct trace_event {
+  const char* name;
+  int id; //counter instance, -1 for spans
+  long long start_ns;
+  long long value; //duration in nanoseconds for spans
+};
+
+/*written only by its own thread; readers copy a range and then discard whatever the writer may have lapped*/
+struct trace_ring {
+  std::unique_ptr<trace_event[]> events{new trace_event[RING_SIZE]};
+  std::atomic<unsigned long long> head{0};
+  unsigned long long reported = 0; //first event not yet in a report, touched only by the reporting thread
+  std::string thread_name;
+  int tid;
+};
+
+struct trace_registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<trace_ring>> rings; //rings outlive their threads so late dumps still see them
+  std::chrono::steady_clock::time_point const epoch = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point last_report = epoch;
+};
+
+}
+
+static trace_registry& registry() {
+  static trace_registry instance;
+  return instance;
+}
+
+static trace_ring& threadRing() {
+  thread_local trace_ring* ring = NULL;
+  if (ring == NULL) {
+    trace_registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.rings.emplace_back(new trace_ring);
+    ring = reg.rings.back().get();
+    ring->tid = static_cast<int>(reg.rings.size());
+    ring->thread_name = "thread " + std::to_string(ring->tid);
+  }
+  return *ring;
+}
+
+static long long sinceEpoch(std::chrono::steady_clock::time_point t) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(t - registry().epoch).count();
+}
+
+static void record(const char* name, int id, long long start_ns, long long value) {
+  trace_ring& ring = threadRing();
+  unsigned long long const head = ring.head.load(std::memory_order_relaxed);
+  ring.events[head % RING_SIZE] = trace_event{name, id, start_ns, value};
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+void traceSpan(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+  record(name, -1, sinceEpoch(start), std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+void traceCounter(const char* name, int id, long value) {
+  record(name, id, sinceEpoch(std::chrono::steady_clock::now()), value);
+}
+
+void traceThreadName(std::string const& name) {
+  trace_ring& ring = threadRing();
+  std::lock_guard<std::mutex> lock(registry().mutex);
+  ring.thread_name = name;
+}
+
+/*copies the events from 'from' onwards that are still intact, returns the position after the last one*/
+static unsigned long long snapshot(trace_ring const& ring, unsigned long long from, std::vector<trace_event>& out) {
+  unsigned long long const head = ring.head.load(std::memory_order_acquire);
+  unsigned long long first = std::max(from, head > RING_SIZE ? head - RING_SIZE : 0ULL);
+  size_t const start = out.size();
+  for (unsigned long long i = first; i < head; i++) { out.push_back(ring.events[i % RING_SIZE]); }
+/*the writer may have overwritten the oldest entries while they were being copied; with its head at
+  'after' it may also be in the middle of writing slot after - RING_SIZE*/
+  unsigned long long const after = ring.head.load(std::memory_order_acquire);
+  if (after >= first + RING_SIZE) {
+    size_t const lapped = static_cast<size_t>(std::min<unsigned long long>(after + 1 - RING_SIZE - first, head - first));
+    out.erase(out.begin() + start, out.begin() + start + lapped);
+  }
+  return head;
+}
+
+bool traceDump(std::string const& path) {
+  std::ofstream out(path);
+  if (!out) { return false; }
+
+  trace_registry& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  std::vector<trace_event> events;
+  bool first = true;
+  auto separator = [&]() -> std::ostream& { out << (first ? "\n" : ",\n"); first = false; return out; };
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  for (auto const& ring : reg.rings) {
+    separator() << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->tid << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+    writeJsonString(out, ring->thread_name);
+    out << "}}";
+
+    events.clear();
+    snapshot(*ring, 0, events);
+    for (auto const& event : events) {
+      double const ts = event.start_ns / 1000.0;
+      if (event.id < 0) {
+        separator() << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->tid << ",\"ts\":" << std::fixed << std::setprecision(3) << ts
+                    << ",\"dur\":" << event.value / 1000.0 << ",\"name\":";
+        writeJsonString(out, event.name);
+        out << "}";
+      } else {
+        separator() << "{\"ph\":\"C\",\"pid\":1,\"tid\":" << ring->tid << ",\"ts\":" << std::fixed << std::setprecision(3) << ts
+                    << ",\"name\":";
+        writeJsonString(out, event.name);
+        out << ",\"args\":{\"" << event.id << "\":" << event.value << "}}";
+      }
+    }
+  }
+  out << "\n]}\n";
+  return static_cast<bool>(out);
+}
+
+void traceReport(std::chrono::seconds period) {
+  trace_registry& reg = registry();
+  auto const now = std::chrono::steady_clock::now();
+  if (period.count() <= 0 || now - reg.last_report < period) { return; }
+  reg.last_report = now;
+
+  std::map<std::string, std::vector<long long>> spans;
+  std::map<std::pair<std::string, int>, std::vector<long long>> counters;
+  std::vector<trace_event> events;
+  {
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (auto const& ring : reg.rings) {
+      events.clear();
+      ring->reported = snapshot(*ring, ring->reported, events);
+      for (auto const& event : events) {
+        if (event.id < 0) { spans[event.name].push_back(event.value); }
+        else { counters[std::make_pair(std::string(event.name), event.id)].push_back(event.value); }
+      }
+    }
+  }
+
+  auto percentile = [](std::vector<long long>& values, double p) {
+    size_t const n = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + n, values.end());
+    return values[n] / 1e6;
+  };
+
+  std::printf("%-16s %8s %9s %9s %9s\n", "stage", "count", "p50 ms", "p95 ms", "p99 ms");
+  for (auto& stage : spans) {
+    std::vector<long long>& values = stage.second;
+    double const p50 = percentile(values, 0.50), p95 = percentile(values, 0.95), p99 = percentile(values, 0.99);
+    std::printf("%-16s %8zu %9.3f %9.3f %9.3f\n", stage.first.c_str(), values.size(), p50, p95, p99);
+  }
+  for (auto& counter : counters) {
+    std::vector<long long> const& values = counter.second;
+    std::printf("%s %d: now %lld, max %lld\n", counter.first.first.c_str(), counter.first.second,
+                values.back(), *std::max_element(values.begin(), values.end()));
+  }
+}
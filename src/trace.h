@@ -0,0 +1,78 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*pipeline instrumentation: every thread records its spans into its own ring buffer, which can be
+  exported as a Chrome/Perfetto trace or summarized as percentiles per stage;
+  configuring with --disable-tracing compiles all of it away*/
+
+/*writes TEXT as a quoted JSON string, for the trace export and the benchmark reports*/
+inline void writeJsonString(std::ostream& out, std::string const& text) {
+  out << '"';
+  for (char c : text) {
+    if (c == '"' || c == '\\') { out << '\\' << c; }
+    else if (static_cast<unsigned char>(c) < 0x20) { out << ' '; }
+    else { out << c; }
+  }
+  out << '"';
+}
+
+/*parses the whole seconds between stage timing reports, 0 turns them off*/
+inline bool parseTraceReportPeriod(std::string const& spec, std::chrono::seconds& period) {
+  char* end;
+  long const value = std::strtol(spec.c_str(), &end, 10);
+  if (end == spec.c_str() || *end != '\0' || value < 0) { return false; }
+  period = std::chrono::seconds(value);
+  return true;
+}
+
+#ifndef DISABLE_TRACING
+
+/*records a completed span, name must be a string literal or otherwise outlive the program*/
+void traceSpan(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+/*records the value of a counter, id tells apart several instances such as one queue per stream*/
+void traceCounter(const char* name, int id, long value);
+/*names the calling thread in exported traces*/
+void traceThreadName(std::string const& name);
+/*writes everything still held in the ring buffers as Chrome trace JSON*/
+bool traceDump(std::string const& path);
+/*prints p50/p95/p99 per stage and counter levels recorded since the last report, at most once per period*/
+void traceReport(std::chrono::seconds period);
+
+class trace_scope {
+public:
+  explicit trace_scope(const char* name) : name(name), start(std::chrono::steady_clock::now()) {}
+  ~trace_scope() { traceSpan(name, start, std::chrono::steady_clock::now()); }
+
+  trace_scope(const trace_scope&) = delete;
+  trace_scope& operator=(const trace_scope&) = delete;
+
+private:
+  const char* const name;
+  std::chrono::steady_clock::time_point const start;
+};
+
+#define TRACE_JOIN_(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN_(a, b)
+#define TRACE_SCOPE(name) trace_scope TRACE_JOIN(trace_scope_, __LINE__)(name)
+#define TRACE_SPAN(name, start, end) traceSpan(name, start, end)
+#define TRACE_COUNTER(name, id, value) traceCounter(name, id, value)
+
+#else
+
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_SPAN(name, start, end) do {} while (0)
+#define TRACE_COUNTER(name, id, value) do {} while (0)
+
+inline void traceThreadName(std::string const&) {}
+inline bool traceDump(std::string const&) { return false; }
+inline void traceReport(std::chrono::seconds) {}
+
+#endif //DISABLE_TRACING
+
+#endif //TRACE_H
@@ -0,0 +1,139 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "tracker.h"
+
+/*every box is followed through a 3x3 grid of points and moved by their median displacement*/
+static const int grid_points = 3;
+static const int min_good_points = 5;
+
+bool parseKeyframeInterval(std::string const& spec, tracker_options& options) {
+  char* end;
+  long const value = std::strtol(spec.c_str(), &end, 10);
+  if (value < 0 || end == spec.c_str()) { return false; }
+  if (std::string(end) == "ms") {
+    options.keyframe_period = std::chrono::milliseconds(value);
+    options.keyframe_interval = 0;
+    return true;
+  }
+  if (*end != '\0') { return false; }
+  options.keyframe_interval = static_cast<int>(value);
+  options.keyframe_period = std::chrono::milliseconds(0);
+  return true;
+}
+
+bool parseMaxFlowError(std::string const& spec, tracker_options& options) {
+  char* end;
+  float const value = std::strtof(spec.c_str(), &end);
+  if (end == spec.c_str() || *end != '\0' || !(value > 0)) { return false; }
+  options.max_flow_error = value;
+  return true;
+}
+
+flow_tracker::flow_tracker(tracker_options const& options) : options(options) {}
+
+bool flow_tracker::keyframeDue(image_data const& frame) const {
+  if (keyframe_pending) { return false; }
+  if (!has_keyframe) { return true; }
+  if (options.keyframe_period.count() > 0) { return frame.timestamp - keyframe_time >= options.keyframe_period; }
+  return frame.frame_id - keyframe_id >= static_cast<unsigned long>(options.keyframe_interval);
+}
+
+void flow_tracker::update(image_data const& frame) {
+  if (frame.frame.empty()) { return; }
+
+  std::swap(gray, prev_gray);
+  cv::resize(frame.frame, small, cv::Size(), options.scale, options.scale, cv::INTER_AREA);
+  cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+
+  if (frame.frame.size() != frame_size) {
+/*the source changed resolution, nothing can be carried over*/
+    frame_size = frame.frame.size();
+    tracked.clear();
+    keyframe_pending = false;
+  } else if (!tracked.empty()) {
+    flow(prev_gray, gray);
+  }
+  publish();
+}
+
+void flow_tracker::keyframeSubmitted(image_data const& frame) {
+  gray.copyTo(keyframe_gray);
+  keyframe_id = frame.frame_id;
+  keyframe_time = frame.timestamp;
+  keyframe_pending = true;
+  has_keyframe = true;
+}
+
+void flow_tracker::seed(detection_result const& result) {
+  if (!keyframe_pending || result.frame_id != keyframe_id) { return; }
+  keyframe_pending = false;
+
+  tracked.clear();
+  for (auto& i : result.boxes) {
+    tracked.push_back(tracked_box{i, static_cast<float>(i.x), static_cast<float>(i.y),
+                                  static_cast<float>(i.w), static_cast<float>(i.h)});
+  }
+/*the detections are a few frames old by now, so catch them up in one step*/
+  if (!tracked.empty() && keyframe_gray.size() == gray.size()) { flow(keyframe_gray, gray); }
+  publish();
+}
+
+void flow_tracker::flow(cv::Mat const& from, cv::Mat const& to) {
+  float const scale = static_cast<float>(options.scale);
+
+  from_points.clear();
+  for (auto& i : tracked) {
+    for (int gy = 1; gy <= grid_points; gy++) {
+      for (int gx = 1; gx <= grid_points; gx++) {
+        from_points.emplace_back((i.x + i.w * gx / (grid_points + 1)) * scale,
+                                 (i.y + i.h * gy / (grid_points + 1)) * scale);
+      }
+    }
+  }
+
+  cv::calcOpticalFlowPyrLK(from, to, from_points, to_points, status, error,
+                           cv::Size(options.window_size, options.window_size), options.max_level);
+
+  size_t kept = 0;
+  for (size_t i = 0; i < tracked.size(); i++) {
+    moved_x.clear();
+    moved_y.clear();
+    for (size_t p = i * grid_points * grid_points; p < (i + 1) * grid_points * grid_points; p++) {
+      if (status[p] && error[p] < options.max_flow_error) {
+        moved_x.push_back((to_points[p].x - from_points[p].x) / scale);
+        moved_y.push_back((to_points[p].y - from_points[p].y) / scale);
+      }
+    }
+/*drop the box if too few of its points could be followed*/
+    if (static_cast<int>(moved_x.size()) < min_good_points) { continue; }
+
+    std::nth_element(moved_x.begin(), moved_x.begin() + moved_x.size() / 2, moved_x.end());
+    std::nth_element(moved_y.begin(), moved_y.begin() + moved_y.size() / 2, moved_y.end());
+    tracked_box box = tracked[i];
+    box.x += moved_x[moved_x.size() / 2];
+    box.y += moved_y[moved_y.size() / 2];
+
+/*drop boxes that have left the frame*/
+    if (box.x + box.w <= 0 || box.y + box.h <= 0 || box.x >= frame_size.width || box.y >= frame_size.height) { continue; }
+    tracked[kept++] = box;
+  }
+  tracked.resize(kept);
+}
+
+void flow_tracker::publish() {
+  output.clear();
+  for (auto& i : tracked) {
+    bbox_t box = i.box;
+    float const x = std::max(i.x, 0.0f), y = std::max(i.y, 0.0f);
+    box.x = static_cast<unsigned int>(x + 0.5f);
+    box.y = static_cast<unsigned int>(y + 0.5f);
+    box.w = static_cast<unsigned int>(std::min(i.x + i.w, static_cast<float>(frame_size.width)) - x + 0.5f);
+    box.h = static_cast<unsigned int>(std::min(i.y + i.h, static_cast<float>(frame_size.height)) - y + 0.5f);
+    output.push_back(box);
+  }
+}
@@ -0,0 +1,66 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include "darknet.h"
+
+struct tracker_options {
+  int keyframe_interval = 0; //frames between detector runs, 0 disables tracking
+  std::chrono::milliseconds keyframe_period{0}; //or the time between detector runs
+  float max_flow_error = 20.0f; //points whose flow error exceeds this are discarded
+  double scale = 0.5; //optical flow runs on a downscaled grayscale frame
+  int window_size = 15;
+  int max_level = 3;
+};
+
+bool parseKeyframeInterval(std::string const& spec, tracker_options& options);
+bool parseMaxFlowError(std::string const& spec, tracker_options& options);
+
+/*moves detected boxes between keyframes with pyramidal Lucas-Kanade optical flow*/
+class flow_tracker {
+public:
+  explicit flow_tracker(tracker_options const& options);
+
+  bool enabled() const { return options.keyframe_interval > 0 || options.keyframe_period.count() > 0; }
+/*true if the detector should be given this frame*/
+  bool keyframeDue(image_data const& frame) const;
+/*follows the tracked boxes into the new frame*/
+  void update(image_data const& frame);
+/*remembers the current frame so that its detections can be carried forward once they arrive*/
+  void keyframeSubmitted(image_data const& frame);
+/*replaces the tracked boxes with the detections of the last keyframe, moved to the current frame*/
+  void seed(detection_result const& result);
+
+  std::vector<bbox_t> const& boxes() const { return output; }
+
+private:
+  struct tracked_box {
+    bbox_t box;
+    float x, y, w, h; //position in full frame coordinates, kept as floats to avoid drift
+  };
+
+  void flow(cv::Mat const& from, cv::Mat const& to);
+  void publish();
+
+  tracker_options const options;
+  cv::Mat small, gray, prev_gray, keyframe_gray;
+  cv::Size frame_size;
+
+  bool keyframe_pending = false, has_keyframe = false;
+  unsigned long keyframe_id = 0;
+  std::chrono::steady_clock::time_point keyframe_time;
+
+  std::vector<tracked_box> tracked;
+  std::vector<bbox_t> output;
+  std::vector<cv::Point2f> from_points, to_points;
+  std::vector<unsigned char> status;
+  std::vector<float> error;
+  std::vector<float> moved_x, moved_y;
+};
+
+#endif //TRACKER_H
@@ -0,0 +1,256 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "v4l2.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/videodev2.h>
+#endif
+
+/*how long a frame may take before the device counts as gone*/
+static const std::chrono::seconds FRAME_TIMEOUT(2);
+
+bool parseV4l2Spec(std::string const& spec, v4l2_options& options) {
+  if (spec.compare(0, 4, "v4l2") != 0) { return false; }
+  if (spec.size() == 4) { return true; }
+  if (spec[4] != ':') { return false; }
+
+  std::string const rest = spec.substr(5);
+  size_t const colon = rest.find(':');
+  if (colon != 0) { options.device = rest.substr(0, colon); }
+  if (colon == std::string::npos) { return !options.device.empty(); }
+
+  int width = 0, height = 0;
+  double fps = options.fps;
+  char separator = 0;
+  std::stringstream geometry(rest.substr(colon + 1));
+  geometry >> width >> separator >> height;
+  if (!geometry || separator != 'x' || width <= 0 || height <= 0) { return false; }
+  if (geometry.peek() == '@') {
+    geometry.get();
+    geometry >> fps;
+    if (!geometry || fps <= 0) { return false; }
+  }
+  if (!geometry.eof() && geometry.peek() != EOF) { return false; }
+  options.size = cv::Size(width, height);
+  options.fps = fps;
+  return !options.device.empty();
+}
+
+#ifdef __linux__
+/*ioctl, restarted when a signal interrupts it*/
+static int xioctl(int fd, unsigned long request, void* arg) {
+  int result;
+  do { result = ioctl(fd, request, arg); } while (result < 0 && errno == EINTR);
+  return result;
+}
+#endif
+
+v4l2_source::v4l2_source(v4l2_options const& options)
+  : options(options) {
+  if (!open()) { close(); }
+}
+
+v4l2_source::~v4l2_source() {
+  close();
+}
+
+bool v4l2_source::open() {
+#ifdef __linux__
+  fd = ::open(options.device.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) { return false; }
+
+  struct v4l2_capability capability = {};
+  if (xioctl(fd, VIDIOC_QUERYCAP, &capability) < 0) { return false; }
+  std::uint32_t const caps = (capability.capabilities & V4L2_CAP_DEVICE_CAPS) ? capability.device_caps : capability.capabilities;
+  if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING)) { return false; }
+
+  if (!negotiate() || !mapBuffers()) { return false; }
+
+  for (size_t i = 0; i < mappings.size(); i++) { requeue(static_cast<int>(i)); }
+  int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if (xioctl(fd, VIDIOC_STREAMON, &type) < 0) { return false; }
+  streaming = true;
+
+/*the pool hands the driver buffers to the pipeline, and releasing a slot queues the buffer again*/
+  if (pixel_format == V4L2_PIX_FMT_BGR24) {
+    pool.reset(new frame_pool(frames, [this](int slot) { requeue(slot); }));
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool v4l2_source::negotiate() {
+#ifdef __linux__
+/*BGR24 is what the pipeline works in, anything else costs a conversion*/
+  static std::uint32_t const preferred[] = {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_YUYV};
+  struct v4l2_format format = {};
+  bool found = false;
+  for (auto fourcc : preferred) {
+    format = v4l2_format();
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format.fmt.pix.width = options.size.width;
+    format.fmt.pix.height = options.size.height;
+    format.fmt.pix.pixelformat = fourcc;
+    format.fmt.pix.field = V4L2_FIELD_NONE;
+    if (xioctl(fd, VIDIOC_S_FMT, &format) == 0 && format.fmt.pix.pixelformat == fourcc) {
+      found = true;
+      break;
+    }
+  }
+  if (!found) { return false; }
+  pixel_format = format.fmt.pix.pixelformat;
+  size = cv::Size(format.fmt.pix.width, format.fmt.pix.height);
+  stride = format.fmt.pix.bytesperline;
+
+/*the frame rate is only a request, drivers without per-frame timing keep their own*/
+  struct v4l2_streamparm parameters = {};
+  parameters.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if (xioctl(fd, VIDIOC_G_PARM, &parameters) == 0 && (parameters.parm.capture.capability & V4L2_CAP_TIMEPERFRAME)) {
+    parameters.parm.capture.timeperframe.numerator = 1000;
+    parameters.parm.capture.timeperframe.denominator = static_cast<std::uint32_t>(options.fps * 1000);
+    xioctl(fd, VIDIOC_S_PARM, &parameters);
+  }
+  struct v4l2_fract const& interval = parameters.parm.capture.timeperframe;
+  if (interval.numerator > 0) { frame_rate = static_cast<double>(interval.denominator) / interval.numerator; }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool v4l2_source::mapBuffers() {
+#ifdef __linux__
+  struct v4l2_requestbuffers request = {};
+  request.count = options.buffer_count;
+  request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  request.memory = V4L2_MEMORY_MMAP;
+  if (xioctl(fd, VIDIOC_REQBUFS, &request) < 0 || request.count < 2) { return false; }
+
+  int const type = (pixel_format == V4L2_PIX_FMT_YUYV) ? CV_8UC2 : CV_8UC3;
+  for (std::uint32_t i = 0; i < request.count; i++) {
+    struct v4l2_buffer buffer = {};
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = i;
+    if (xioctl(fd, VIDIOC_QUERYBUF, &buffer) < 0) { return false; }
+    void* const start = mmap(NULL, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buffer.m.offset);
+    if (start == MAP_FAILED) { return false; }
+    mappings.push_back(mapping{start, buffer.length});
+    frames.emplace_back(size, type, start, stride);
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void v4l2_source::close() {
+#ifdef __linux__
+  if (streaming) {
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    xioctl(fd, VIDIOC_STREAMOFF, &type);
+    streaming = false;
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    queued = 0; //STREAMOFF takes every buffer back from the driver
+  }
+  pool.reset();
+  frames.clear();
+  for (auto const& m : mappings) { munmap(m.start, m.length); }
+  mappings.clear();
+  if (fd >= 0) { ::close(fd); }
+#endif
+  fd = -1;
+}
+
+void v4l2_source::requeue(int index) {
+#ifdef __linux__
+  if (fd < 0) { return; }
+  struct v4l2_buffer buffer = {};
+  buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  buffer.memory = V4L2_MEMORY_MMAP;
+  buffer.index = static_cast<std::uint32_t>(index);
+  if (xioctl(fd, VIDIOC_QBUF, &buffer) < 0) { return; }
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    queued++;
+  }
+  requeued.notify_one();
+#endif
+}
+
+int v4l2_source::waitForBuffer() {
+#ifdef __linux__
+  auto deadline = std::chrono::steady_clock::now() + FRAME_TIMEOUT;
+  while (streaming && std::chrono::steady_clock::now() < deadline) {
+/*while the pipeline holds every buffer the driver has nothing to fill, which is no sign of a dead
+  device: wait for a buffer to come back, and only start the timeout once one has*/
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      if (queued == 0) {
+        requeued.wait_for(guard, std::chrono::milliseconds(100));
+        guard.unlock();
+        if (pool && pool->isShutdown()) { return -1; }
+        deadline = std::chrono::steady_clock::now() + FRAME_TIMEOUT;
+        continue;
+      }
+    }
+/*short waits, so a shut down pool is noticed quickly*/
+    struct pollfd waiting = {fd, POLLIN, 0};
+    int const ready = poll(&waiting, 1, 100);
+    if (pool && pool->isShutdown()) { return -1; }
+    if (ready < 0 && errno != EINTR) { return -1; }
+    if (ready <= 0) { continue; }
+
+    struct v4l2_buffer buffer = {};
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(fd, VIDIOC_DQBUF, &buffer) < 0) {
+      if (errno == EAGAIN) { continue; }
+      return -1;
+    }
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      queued--;
+    }
+    if (buffer.flags & V4L2_BUF_FLAG_ERROR) {
+      requeue(buffer.index);
+      continue;
+    }
+    return static_cast<int>(buffer.index);
+  }
+#endif
+  return -1;
+}
+
+int v4l2_source::dequeue() {
+  int const index = waitForBuffer();
+  if (index < 0 || !pool) { return -1; }
+  return pool->claim(index);
+}
+
+void v4l2_source::read(cv::Mat& frame) {
+  int const index = waitForBuffer();
+  if (index < 0) {
+    frame.release(); //the device is gone
+    return;
+  }
+#ifdef __linux__
+  switch (pixel_format) {
+    case V4L2_PIX_FMT_BGR24: frames[index].copyTo(frame); break;
+    case V4L2_PIX_FMT_RGB24: cv::cvtColor(frames[index], frame, cv::COLOR_RGB2BGR); break;
+    case V4L2_PIX_FMT_YUYV: cv::cvtColor(frames[index], frame, cv::COLOR_YUV2BGR_YUYV); break;
+  }
+#endif
+  requeue(index);
+}
@@ -0,0 +1,73 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef V4L2_H
+#define V4L2_H
+
+#include "capture.h"
+
+struct v4l2_options {
+  std::string device = "/dev/video0";
+  cv::Size size{1280, 720}; //what is asked for, the driver picks the nearest it supports
+  double fps = 60;
+  int buffer_count = 13; //driver buffers: a full fifo queue of 10, one being processed, one on display, one being filled
+};
+
+/*parses "v4l2[:DEVICE[:WxH[@FPS]]]", e.g. "v4l2:/dev/video2:1920x1080@30"*/
+bool parseV4l2Spec(std::string const& spec, v4l2_options& options);
+
+/*captures from a Video4Linux2 device through memory mapped driver buffers.
+  BGR24 frames are never copied: the stream gets a pool over the driver buffers, every frame is a
+  cv::Mat header on one of them, and a buffer goes back to the driver when the pipeline releases
+  its slot. Devices that only offer RGB24 or YUYV are converted into the stream's own buffers,
+  which is still one copy less than going through cv::VideoCapture*/
+class v4l2_source : public frame_source {
+public:
+  explicit v4l2_source(v4l2_options const& options);
+  ~v4l2_source();
+
+  v4l2_source(const v4l2_source&) = delete;
+  v4l2_source& operator=(const v4l2_source&) = delete;
+
+  bool isOpened() const { return streaming; }
+  bool zeroCopy() const { return static_cast<bool>(pool); }
+
+  void read(cv::Mat& frame) override;
+  frame_pool* ownBuffers() override { return pool.get(); }
+  int dequeue() override;
+  double frameRate() const override { return frame_rate; }
+
+private:
+  bool open();
+  bool negotiate();
+  bool mapBuffers();
+  void close();
+/*waits for the driver to fill a buffer and returns its index, -1 on a timeout, an error or shutdown;
+  the timeout only runs while the driver has a buffer to fill, not while the pipeline holds them all*/
+  int waitForBuffer();
+  void requeue(int index);
+
+  v4l2_options const options;
+  int fd = -1;
+  bool streaming = false;
+  std::uint32_t pixel_format = 0;
+  cv::Size size;
+  size_t stride = 0;
+  double frame_rate = 0; //as the driver reports it
+
+  struct mapping {
+    void* start;
+    size_t length;
+  };
+  std::vector<mapping> mappings;
+  std::vector<cv::Mat> frames; //the driver buffers, in the device's pixel format
+  std::unique_ptr<frame_pool> pool; //only for BGR24
+  std::mutex lock;
+  std::condition_variable requeued;
+  int queued = 0; //buffers the driver holds, guarded by lock
+};
+
+#endif //V4L2_H
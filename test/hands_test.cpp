@@ -0,0 +1,104 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "hands.h"
+
+/*checks that hand_filter and hand_replay cope with frames whose two hands share an id,
+  as a hand-made or corrupted -L file can contain*/
+
+Globals global;
+
+/*keeps every frame it is given*/
+struct collector : public hand_listener {
+  std::mutex mutex;
+  std::vector<hand_frame> frames;
+
+  void onHands(hand_frame const& frame) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    frames.push_back(frame);
+  }
+};
+
+static hand_frame makeFrame(std::int64_t frame_id, std::initializer_list<std::int32_t> ids) {
+  hand_frame frame = hand_frame();
+  frame.frame_id = frame_id;
+  frame.timestamp_us = frame_id * 8333;
+  for (std::int32_t id : ids) {
+    hand_sample& hand = frame.hands[frame.hand_count++];
+    hand.id = id;
+    for (int axis = 0; axis < 3; axis++) {
+      hand.palm[axis] = 10.0f * (frame.hand_count + axis);
+      hand.palm_normal[axis] = axis == 1 ? 1.0f : 0.0f;
+      for (int finger = 0; finger < 5; finger++) { hand.tips[finger][axis] = hand.palm[axis] + finger; }
+    }
+  }
+  return frame;
+}
+
+static bool isFinite(hand_frame const& frame) {
+  for (int h = 0; h < frame.hand_count; h++) {
+    hand_sample const& hand = frame.hands[h];
+    for (int axis = 0; axis < 3; axis++) {
+      if (!std::isfinite(hand.palm[axis]) || !std::isfinite(hand.palm_normal[axis])) { return false; }
+      for (int finger = 0; finger < 5; finger++) { if (!std::isfinite(hand.tips[finger][axis])) { return false; } }
+    }
+  }
+  return true;
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+  std::printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok) { failures++; }
+}
+
+int main() {
+/*the filter on its own: {5,5} leaves both tracks on id 5, then {5,7} must still find one for 7*/
+  {
+    hand_filter filter;
+    hand_frame const frames[] = {makeFrame(1, {5, 5}), makeFrame(2, {5, 7}), makeFrame(3, {7, 7}), makeFrame(4, {9})};
+    bool ok = true;
+    for (auto const& frame : frames) {
+      filter.onHands(frame);
+      hand_frame const smoothed = global.hands.load();
+      ok = ok && smoothed.frame_id == frame.frame_id && smoothed.hand_count == frame.hand_count && isFinite(smoothed);
+      for (int h = 0; h < frame.hand_count; h++) { ok = ok && smoothed.hands[h].id == frame.hands[h].id; }
+    }
+    check(ok, "filter keeps duplicate hand ids in bounds");
+  }
+
+/*a recorded file with duplicate ids plays back with the second hand dropped*/
+  {
+    char path[] = "/tmp/hands_test.XXXXXX";
+    int const fd = mkstemp(path);
+    if (fd < 0) {
+      std::perror("mkstemp");
+      return EXIT_FAILURE;
+    }
+    close(fd);
+    {
+      collector sink;
+      hand_recorder recorder(path, sink);
+      recorder.onHands(makeFrame(1, {5, 5}));
+      recorder.onHands(makeFrame(2, {5, 7}));
+    }
+    collector sink;
+    hand_replay replay(path, sink, 0.0, false);
+    bool const started = replay.start();
+    check(started, "replay reads the recorded file");
+    if (started) {
+      while (replay.played() < replay.frameCount()) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+      replay.stop();
+      check(sink.frames.size() == 2 && sink.frames[0].hand_count == 1 && sink.frames[0].hands[0].id == 5,
+            "replay drops a second hand with the same id");
+      check(sink.frames.size() == 2 && sink.frames[1].hand_count == 2, "replay keeps hands with distinct ids");
+    }
+    std::remove(path);
+  }
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,295 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "input.h"
+#include "edges.h"
+#include "synth.h"
+#include "pose.h"
+#include "hands.h"
+#include "rendering.h"
+
+#ifndef DISABLE_DARKNET
+#include "darknet.h"
+#include "text.h"
+#endif
+
+#include <benchmark/benchmark.h>
+
+/*conhud-microbench times the per-frame hot paths in isolation, run it with
+  --benchmark_format=json (or --benchmark_out=FILE) to keep results comparable between builds*/
+
+Globals global;
+
+static const int RESOLUTIONS[][2] = {{640, 480}, {1280, 720}, {1920, 1080}};
+
+/*a frame with some structure in it, the same on every run*/
+static cv::Mat makeFrame(int width, int height, synth_content content = synth_content::shapes) {
+  synth_options options;
+  options.size = cv::Size(width, height);
+  options.fps = 0;
+  options.content = content;
+  synth_source source(options);
+  cv::Mat frame;
+  source.read(frame);
+  return frame;
+}
+
+static void resolutionArgs(benchmark::internal::Benchmark* b) {
+  for (auto const& r : RESOLUTIONS) { b->Args({r[0], r[1]}); }
+}
+
+static void resolutionAndBoxArgs(benchmark::internal::Benchmark* b) {
+  for (auto const& r : RESOLUTIONS) {
+    for (int boxes : {0, 10, 100, 1000}) { b->Args({r[0], r[1], boxes}); }
+  }
+}
+
+static void BM_EdgeOverlay(benchmark::State& state, edge_detector detector, bool edges_only) {
+  cv::Mat const source = makeFrame(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+  cv::Mat frame;
+  edge_overlay edges(detector);
+  for (auto _ : state) {
+    state.PauseTiming();
+    source.copyTo(frame);
+    state.ResumeTiming();
+    edges.apply(frame, edges_only);
+    benchmark::DoNotOptimize(frame.data);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_EdgeOverlay, canny, edge_detector::canny, false)->Apply(resolutionArgs)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_EdgeOverlay, sobel, edge_detector::sobel, false)->Apply(resolutionArgs)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_EdgeOverlay, canny_edges_only, edge_detector::canny, true)->Apply(resolutionArgs)->Unit(benchmark::kMillisecond);
+
+/*draining a frame's worth of input: a key press followed by a burst of cursor moves*/
+static void BM_HandleEvents(benchmark::State& state) {
+  int const burst = static_cast<int>(state.range(0));
+  for (auto _ : state) {
+    auto const now = std::chrono::steady_clock::now();
+    global.input_events.push(control_event{control_event::KEY, GLFW_KEY_Z, 0, GLFW_PRESS, 0, 0, 0, now});
+    for (int i = 1; i < burst; i++) {
+      global.input_events.push(control_event{control_event::CURSOR, 0, 0, 0, 0, double(i), double(i), now});
+    }
+    benchmark::DoNotOptimize(handleEvents());
+  }
+  state.SetItemsProcessed(state.iterations() * burst);
+}
+BENCHMARK(BM_HandleEvents)->Arg(1)->Arg(16)->Arg(128);
+
+/*looking up the pose at capture time in a full history and latching it for both eyes*/
+static void BM_PoseLatch(benchmark::State& state) {
+  scripted_pose_source poses(10.0f, 0.5f);
+  pose_reprojection reprojection(poses, 90.0f);
+  for (int i = 0; i < 128; i++) { reprojection.sample(); }
+  auto const captured = std::chrono::steady_clock::now() - std::chrono::milliseconds(30);
+  for (auto _ : state) {
+    reprojection.setFrameTime(captured);
+    reprojection.latch(1920, 1080);
+    reprojection.latch(1920, 1080);
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_PoseLatch);
+
+/*smoothing one Leap Motion frame, with one or two hands moving at the device's rate*/
+static void BM_HandFilter(benchmark::State& state) {
+  int const hand_count = static_cast<int>(state.range(0));
+  std::vector<hand_frame> frames(240);
+  for (size_t i = 0; i < frames.size(); i++) {
+    hand_frame& frame = frames[i];
+    frame = hand_frame();
+    frame.frame_id = static_cast<std::int64_t>(i);
+    frame.timestamp_us = static_cast<std::int64_t>(i) * 8333; //120 Hz
+    frame.hand_count = hand_count;
+    for (int h = 0; h < hand_count; h++) {
+      hand_sample& hand = frame.hands[h];
+      float const t = i * 0.05f + h;
+      hand.id = h + 1;
+      hand.right = h;
+      for (int axis = 0; axis < 3; axis++) {
+        hand.palm[axis] = 100.0f * std::sin(t + axis);
+        hand.palm_normal[axis] = std::cos(t + axis);
+        for (int finger = 0; finger < 5; finger++) { hand.tips[finger][axis] = hand.palm[axis] + 20.0f * finger; }
+      }
+    }
+  }
+/*the timestamps keep moving forward across passes, like hand_replay does*/
+  hand_filter filter;
+  std::int64_t offset_us = 0;
+  size_t i = 0;
+  for (auto _ : state) {
+    hand_frame frame = frames[i];
+    frame.timestamp_us += offset_us;
+    filter.onHands(frame);
+    if (++i == frames.size()) {
+      i = 0;
+      offset_us += static_cast<std::int64_t>(frames.size()) * 8333;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HandFilter)->Arg(1)->Arg(2);
+
+/*the GL cases draw into a hidden window the size of conhud's fullscreen one, with the same context
+  version as conhud; they run on a software rasterizer such as llvmpipe too, and are reported as
+  skipped where no context can be made*/
+static const int GL_WINDOW_W = 1920, GL_WINDOW_H = 1080;
+
+static GLFWwindow* createGLContext() {
+  if (!glfwInit()) { return NULL; }
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  GLFWwindow* window = glfwCreateWindow(GL_WINDOW_W, GL_WINDOW_H, "conhud-microbench", NULL, NULL);
+  if (window == NULL) { return NULL; }
+  glfwMakeContextCurrent(window);
+  glewExperimental = true;
+  if (glewInit() != GLEW_OK || !initRenderer(GL_WINDOW_W, GL_WINDOW_H)) {
+    glfwDestroyWindow(window);
+    return NULL;
+  }
+  glfwSwapInterval(0);
+  return window;
+}
+
+/*made once, on first use, and shared by all GL cases*/
+static GLFWwindow* glContext() {
+  static GLFWwindow* const window = createGLContext();
+  return window;
+}
+
+/*what the render thread pays to hand a new frame to the GPU: writing it into the next PBO of the
+  ring and queueing the texture update; the transfer itself is waited for outside the timing*/
+static void BM_UploadVideoTexture(benchmark::State& state) {
+  if (!glContext()) {
+    state.SkipWithError("no OpenGL context");
+    return;
+  }
+  cv::Mat const frame = makeFrame(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+  video_texture video;
+  createVideoTexture(video, frame.cols, frame.rows);
+  for (auto _ : state) {
+    uploadVideoTexture(video, frame);
+    state.PauseTiming();
+    glFinish();
+    state.ResumeTiming();
+  }
+  destroyVideoTexture(video);
+  state.SetBytesProcessed(state.iterations() * frame.total() * frame.elemSize());
+}
+BENCHMARK(BM_UploadVideoTexture)->Apply(resolutionArgs)->Unit(benchmark::kMicrosecond);
+
+/*a whole video frame to the screen: the upload, the textured quad and the GPU finishing both*/
+static void BM_DrawToGLFW(benchmark::State& state) {
+  if (!glContext()) {
+    state.SkipWithError("no OpenGL context");
+    return;
+  }
+  cv::Mat const frame = makeFrame(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+  video_texture video;
+  createVideoTexture(video, frame.cols, frame.rows);
+  glViewport(0, 0, GL_WINDOW_W, GL_WINDOW_H);
+  for (auto _ : state) {
+    uploadVideoTexture(video, frame);
+    glClear(GL_COLOR_BUFFER_BIT);
+    drawToGLFW(video, GL_WINDOW_W, GL_WINDOW_H);
+    glFinish();
+  }
+  destroyVideoTexture(video);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DrawToGLFW)->Apply(resolutionArgs)->Unit(benchmark::kMicrosecond);
+
+#ifndef DISABLE_DARKNET
+
+static std::vector<std::string> const OBJECT_NAMES = {"person", "head", "car", "weapon", "drone", "flag"};
+
+/*boxes spread over the frame, a sixth of them heads*/
+static std::vector<bbox_t> makeBoxes(int count, int width, int height) {
+  cv::RNG rng(1);
+  std::vector<bbox_t> boxes;
+  for (int i = 0; i < count; i++) {
+    bbox_t box;
+    box.w = rng.uniform(20, width / 4);
+    box.h = rng.uniform(20, height / 4);
+    box.x = rng.uniform(0, width - static_cast<int>(box.w));
+    box.y = rng.uniform(0, height - static_cast<int>(box.h));
+    box.prob = 0.5f;
+    box.obj_id = static_cast<unsigned int>(i % OBJECT_NAMES.size());
+    box.track_id = static_cast<unsigned int>(i % 3 == 0 ? i : 0);
+    box.frames_counter = 0;
+    boxes.push_back(box);
+  }
+  return boxes;
+}
+
+static void BM_DrawBoxes(benchmark::State& state) {
+  int const width = static_cast<int>(state.range(0)), height = static_cast<int>(state.range(1));
+  cv::Mat const source = makeFrame(width, height);
+  auto const boxes = makeBoxes(static_cast<int>(state.range(2)), width, height);
+  cv::Mat frame;
+  for (auto _ : state) {
+    state.PauseTiming();
+    source.copyTo(frame);
+    state.ResumeTiming();
+    drawBoxes(frame, boxes, OBJECT_NAMES);
+    benchmark::DoNotOptimize(frame.data);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(2));
+}
+BENCHMARK(BM_DrawBoxes)->Apply(resolutionAndBoxArgs)->Unit(benchmark::kMicrosecond);
+
+static void BM_BuildOverlay(benchmark::State& state) {
+  int const width = static_cast<int>(state.range(0)), height = static_cast<int>(state.range(1));
+  auto const boxes = makeBoxes(static_cast<int>(state.range(2)), width, height);
+  std::vector<overlay_instance> instances;
+  std::vector<text_item> labels;
+  for (auto _ : state) {
+    buildOverlay(boxes, OBJECT_NAMES, cv::Size(width, height), instances, labels);
+    benchmark::DoNotOptimize(instances.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(2));
+}
+BENCHMARK(BM_BuildOverlay)->Apply(resolutionAndBoxArgs)->Unit(benchmark::kMicrosecond);
+
+static void BM_ObjectIdToColor(benchmark::State& state) {
+  int id = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(objectIdToColor(id));
+    id = (id + 1) % 1000;
+  }
+}
+BENCHMARK(BM_ObjectIdToColor);
+
+/*the detector input for a 416x416 network, which is what yolo-voc uses*/
+static void BM_DetectorInput(benchmark::State& state) {
+  cv::Mat const frame = makeFrame(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+  detector_input input(416, 416);
+  for (auto _ : state) {
+    image_t const& tensor = input.convert(frame);
+    benchmark::DoNotOptimize(tensor.data);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DetectorInput)->Apply(resolutionArgs)->Unit(benchmark::kMicrosecond);
+
+static void BM_BgrToPlanarRgb(benchmark::State& state) {
+  cv::Mat const frame = makeFrame(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+  std::vector<float> tensor(frame.total() * 3);
+  for (auto _ : state) {
+    bgrToPlanarRgb(frame.data, frame.step, frame.cols, frame.rows, tensor.data());
+    benchmark::DoNotOptimize(tensor.data());
+  }
+  state.SetBytesProcessed(state.iterations() * frame.total() * 3);
+}
+BENCHMARK(BM_BgrToPlanarRgb)->Apply(resolutionArgs)->Unit(benchmark::kMicrosecond);
+
+#endif //DISABLE_DARKNET
+
+BENCHMARK_MAIN();
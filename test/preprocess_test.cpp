@@ -0,0 +1,53 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "preprocess.h"
+
+/*checks that every detector input kernel is bit-identical to Detector::mat_to_image(), on widths
+  that fill whole vectors, leave a remainder for the scalar tail, or are narrower than a vector*/
+
+static const int WIDTHS[] = {1, 7, 15, 33, 1920};
+static const int HEIGHT = 5;
+
+static const struct {
+  convert_kernel kernel;
+  const char* name;
+} KERNELS[] = {
+  {convert_kernel::scalar, "scalar"},
+  {convert_kernel::sse41, "sse4.1"},
+  {convert_kernel::avx2, "avx2"},
+};
+
+int main() {
+  cv::RNG rng(7);
+  int failures = 0;
+  for (int width : WIDTHS) {
+/*a view into a wider frame, so rows are not contiguous*/
+    cv::Mat padded(HEIGHT, width + 5, CV_8UC3);
+    rng.fill(padded, cv::RNG::UNIFORM, 0, 256);
+    cv::Mat const frame = padded(cv::Rect(2, 0, width, HEIGHT));
+
+    auto const reference = Detector::mat_to_image(frame);
+    size_t const count = static_cast<size_t>(width) * HEIGHT * 3;
+    std::vector<float> output(count);
+
+    for (auto const& k : KERNELS) {
+      std::fill(output.begin(), output.end(), -1.0f);
+      if (!bgrToPlanarRgb(k.kernel, frame.data, frame.step, width, HEIGHT, output.data())) {
+        std::printf("SKIP %s width %d: not supported by this CPU\n", k.name, width);
+        continue;
+      }
+      if (std::memcmp(output.data(), reference->data, count * sizeof(float)) != 0) {
+        std::printf("FAIL %s width %d: differs from Detector::mat_to_image()\n", k.name, width);
+        failures++;
+        continue;
+      }
+      std::printf("PASS %s width %d\n", k.name, width);
+    }
+  }
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
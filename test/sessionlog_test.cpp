@@ -0,0 +1,124 @@
+/* This is free and unencumbered software released into the public domain. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "globals.h"
+#include "sessionlog.h"
+
+/*checks that session_reader turns truncated and corrupted logs down, or reads what is left of them,
+  instead of throwing or reading outside the map*/
+
+Globals global;
+
+static const int WIDTH = 64, HEIGHT = 48, FRAMES = 3;
+static_assert(sizeof(session_index_entry) == 40, "the wrapping index count below assumes 40-byte entries");
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+  std::printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok) { failures++; }
+}
+
+static std::vector<char> readFile(std::string const& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(std::string const& path, std::vector<char> const& bytes) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(bytes.data(), bytes.size());
+}
+
+/*opens the log and reads every frame in it, false if anything throws*/
+static bool readAll(std::string const& path, bool& opened, size_t& frames, size_t& readable) {
+  opened = false;
+  frames = readable = 0;
+  try {
+    session_reader reader;
+    opened = reader.open(path);
+    frames = reader.frameCount();
+    session_frame frame;
+    for (size_t i = 0; i < frames; i++) {
+      if (reader.frame(i, frame)) { readable++; }
+    }
+    reader.inputs();
+  } catch (std::exception const& e) {
+    std::printf("  threw: %s\n", e.what());
+    return false;
+  }
+  return true;
+}
+
+/*the log with the record header of its first frame changed at FIELD*/
+template <typename T>
+static std::vector<char> withFirstFrame(std::vector<char> bytes, size_t field, T value) {
+  std::memcpy(bytes.data() + sizeof(session_file_header) + field, &value, sizeof(value));
+  return bytes;
+}
+
+int main() {
+  char path[] = "/tmp/sessionlog_test.XXXXXX";
+  int const fd = mkstemp(path);
+  if (fd < 0) {
+    std::perror("mkstemp");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+  std::string const damaged = std::string(path) + ".damaged";
+
+  {
+    session_writer writer(path);
+    if (!writer.open(WIDTH * HEIGHT * 3)) {
+      std::printf("FAIL cannot write %s\n", path);
+      return EXIT_FAILURE;
+    }
+    auto const now = std::chrono::steady_clock::now();
+    for (int i = 0; i < FRAMES; i++) {
+      cv::Mat const frame(HEIGHT, WIDTH, CV_8UC3, cv::Scalar(i, 2 * i, 3 * i));
+      writer.addFrame(0, i, now + std::chrono::milliseconds(33 * i), frame);
+      writer.addBoxes(0, i, now + std::chrono::milliseconds(33 * i), {session_box{1, 2, 3, 4, 0.5f, 0, 0, 0}});
+    }
+    writer.close();
+  }
+  std::vector<char> const log = readFile(path);
+  size_t const record_bytes = sizeof(session_record) + WIDTH * HEIGHT * 3; //a multiple of 64 already
+
+  bool opened;
+  size_t frames, readable;
+  check(readAll(path, opened, frames, readable) && opened && frames == FRAMES && readable == FRAMES, "an intact log reads every frame");
+
+/*cut in the middle of the second frame: the index is gone and only the first frame is complete*/
+  std::vector<char> truncated(log.begin(), log.begin() + sizeof(session_file_header) + record_bytes + sizeof(session_record) + record_bytes / 2);
+  writeFile(damaged, truncated);
+  check(readAll(damaged, opened, frames, readable) && opened && frames == 1 && readable == 1, "a truncated log reads the frames before the cut");
+
+  truncated.resize(sizeof(session_file_header) / 2);
+  writeFile(damaged, truncated);
+  check(readAll(damaged, opened, frames, readable) && !opened, "a log cut inside the file header is refused");
+
+/*frame headers whose geometry cv::Mat would throw on, or that does not match the payload*/
+  writeFile(damaged, withFirstFrame(log, offsetof(session_record, width), std::int32_t(-5)));
+  check(readAll(damaged, opened, frames, readable) && opened && readable == FRAMES - 1, "a negative width is refused");
+  writeFile(damaged, withFirstFrame(log, offsetof(session_record, height), std::int32_t(1) << 30));
+  check(readAll(damaged, opened, frames, readable) && opened && readable == FRAMES - 1, "a huge height is refused");
+  writeFile(damaged, withFirstFrame(log, offsetof(session_record, type), std::int32_t(1000)));
+  check(readAll(damaged, opened, frames, readable) && opened && readable == FRAMES - 1, "an unknown matrix type is refused");
+  writeFile(damaged, withFirstFrame(log, offsetof(session_record, size), std::uint64_t(16)));
+  check(readAll(damaged, opened, frames, readable) && opened && readable == FRAMES - 1, "a payload size that does not match is refused");
+
+/*an index count that only matches the file size once the multiplication wraps around*/
+  std::vector<char> footer_damaged = log;
+  std::uint64_t const wrapping_count = FRAMES + (std::uint64_t(1) << 61); //times 40 bytes wraps to the real index size
+  std::memcpy(footer_damaged.data() + footer_damaged.size() - sizeof(session_footer) + offsetof(session_footer, index_count),
+              &wrapping_count, sizeof(wrapping_count));
+  writeFile(damaged, footer_damaged);
+  check(readAll(damaged, opened, frames, readable) && opened && frames == FRAMES && readable == FRAMES,
+        "a wrapping index count falls back to the record headers");
+
+  std::remove(damaged.c_str());
+  std::remove(path);
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}